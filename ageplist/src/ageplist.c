@@ -21,14 +21,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <stdint.h>
 
-#include "xltables.h"
+#include "xltokens.h"
+#include "stats.h"
+#include "sink.h"
+#include "zx81rom.h"
+#include "zx81list.h"
 
 static void usage(FILE* out)
 {
   fprintf(out, "AGEPLIST - A Good Enough P LIST program.\n");
   fprintf(out, "Copyright (C) 2010 Andre de Leiradella. Released under the GPL.\n\n");
-  fprintf(out, "Usage: ageplist [-h] [-c] [-z] [-w width] [-s n] [-f] [-a] [-o output] input.p\n\n");
+  fprintf(out, "Usage: ageplist [-h] [-c] [-z] [-w width] [-s n] [-f] [-a] [-e] [-o output] [--stats] input.p\n\n");
   fprintf(out, "-h    Show this help screen\n");
   fprintf(out, "-c    Show the current line cursor (toggle, default: no)\n");
   fprintf(out, "-z    Use the ZX-81.TTF font (toggle, default: no)\n");
@@ -36,7 +41,9 @@ static void usage(FILE* out)
   fprintf(out, "-s    Set the first line to list (default: 0)\n");
   fprintf(out, "-f    Don't stop the listing on spurious program endings (toggle, default: no)\n");
   fprintf(out, "-a    Accurate (turns -c and -z on, -w to 32 and -f off (default: no)\n");
-  fprintf(out, "-o    Output listing to file \"output\" (default: stdout)\n\n");
+  fprintf(out, "-e    Exact: list as the ROM does, the same as wmaplist (toggle, default: no)\n");
+  fprintf(out, "-o    Output listing to file \"output\" (default: stdout)\n");
+  fprintf(out, "--stats Print the times of each phase and the amounts read and output to stderr\n\n");
 }
 
 static inline int peekb(const unsigned char* buffer, int addr)
@@ -53,26 +60,44 @@ static inline int peekw(const unsigned char* buffer, int addr)
   return peekb(buffer, addr) << 8 | peekb(buffer, addr + 1);
 }
 
-static inline void print(FILE* out, const char* what, int width, int* column, int* was_space)
+static inline void print(sink_t* out, const xltoken_t* token, int width, int* column, int* was_space, stats_t* stats)
 {
-  if (*what == ' ' && what[1] != 0 && *was_space)
+  const char* what = token->text;
+  size_t size = token->size;
+  if ((token->flags & XL_LEADING) && *was_space)
   {
     what++;
+    size--;
   }
-  while (*what != 0)
+  const char* end = what + size;
+  stats->chars += size;
+  // copy it whole unless the line has to be broken inside it
+  if (*column >= width || *column + (int)size < width)
   {
-    if (++(*column) == width)
+    sink_write(out, what, size);
+    *column += size;
+  }
+  else
+  {
+    while (what < end)
     {
-      fprintf(out, "\n");
-      *column = 0;
+      if (++(*column) == width)
+      {
+        sink_putc(out, '\n');
+        *column = 0;
+        stats->lines++;
+        stats->chars++;
+      }
+      sink_putc(out, *what++);
     }
-    fprintf(out, "%c", *what++);
   }
-  *was_space = what[-1] == ' ';
+  *was_space = (token->flags & XL_TRAILING) != 0;
 }
 
 int main(int argc, const char* argv[])
 {
+  double started = now();
+  
   // check execution without arguments
   if (argc < 2)
   {
@@ -82,13 +107,17 @@ int main(int argc, const char* argv[])
   
   // configuration variables
   int show_cursor = 0;
-  const char** table = table_ascii;
+  const xltoken_t* table = tokens_ascii;
   const char* output_name = "<stdout>";
   FILE* output = stdout;
   const char* input_name = NULL;
   int width = 32;
   int start = 0;
   int full = 0;
+  int exact = 0;
+  int show_stats = 0;
+  stats_t stats;
+  memset(&stats, 0, sizeof(stats));
   
   // process command line arguments
   int i;
@@ -100,7 +129,7 @@ int main(int argc, const char* argv[])
     }
     else if (!strcmp(argv[i], "-z"))
     {
-      table = table == table_ascii ? table_zx81 : table_ascii;
+      table = table == tokens_ascii ? tokens_zx81 : tokens_ascii;
     }
     else if (!strcmp(argv[i], "-w"))
     {
@@ -114,7 +143,7 @@ int main(int argc, const char* argv[])
     else if (!strcmp(argv[i], "-a"))
     {
       show_cursor = 1;
-      table = table_zx81;
+      table = tokens_zx81;
       width = 32;
       full = 0;
     }
@@ -136,6 +165,10 @@ int main(int argc, const char* argv[])
     {
       full = !full;
     }
+    else if (!strcmp(argv[i], "-e"))
+    {
+      exact = !exact;
+    }
     else if (!strcmp(argv[i], "-o"))
     {
       if ((i + 1) >= argc)
@@ -145,6 +178,10 @@ int main(int argc, const char* argv[])
       }
       output_name = argv[++i];
     }
+    else if (!strcmp(argv[i], "--stats"))
+    {
+      show_stats = 1;
+    }
     else if (argv[i][0] != '-')
     {
       input_name = argv[i];
@@ -162,14 +199,15 @@ int main(int argc, const char* argv[])
   }
   
   // load input file
+  double load = now();
   FILE* input = fopen(input_name, "rb");
   if (input == NULL)
   {
     fprintf(stderr, "Error opening input file: %s\n", strerror(errno));
     return -1;
   }
-  unsigned char buffer[65536];
-  fread(buffer + 0x4009, 1, sizeof(buffer) - 0x4009, input);
+  static unsigned char buffer[65536];
+  size_t size = fread(buffer + 0x4009, 1, sizeof(buffer) - 0x4009, input);
   if (ferror(input))
   {
     fprintf(stderr, "Error reading input file: %s\n", strerror(errno));
@@ -177,6 +215,9 @@ int main(int argc, const char* argv[])
     return -1;
   }
   fclose(input);
+  stats.files = 1;
+  stats.bytes = size;
+  stats.load = now() - load;
   
   // setup output file
   if (strcmp(output_name, "<stdout>"))
@@ -188,93 +229,134 @@ int main(int argc, const char* argv[])
       return -1;
     }
   }
+  // with --stats the listing is kept in memory and written at the end,
+  // so the decoding and the writing are timed apart
+  sink_t sink;
+  sink_init(&sink, show_stats ? NULL : output);
   
   // list BASIC program
+  double setup = now();
   int current = 0x407d; // address of first line
   int was_space = 0;    // true if last character was a space
   int column = 0;       // column counter
   int cursor = peekb(buffer, 0x400a) | peekb(buffer, 0x400b) << 8; // number of line with the cursor
-  // a 0x76 marks the end of the program
-  while (peekb(buffer, current) != 0x76)
+  if (exact)
   {
-    // evaluate the next line
-    int next_line = current + (peekb(buffer, current + 2) | peekb(buffer, current + 3) << 8) + 4;
-    // get the line number
-    int line = peekw(buffer, current);
-    // listing ends if line number is >= 16384
-    if (line >= 16384)
+    // the characters the ROM's LIST prints, as wmaplist outputs them
+    if (full && rom_list_full(buffer) != 0)
     {
-      break;
-    }
-    // if line is less than the first line to list...
-    if (line < start)
-    {
-      // restart loop in the next line
-      current = next_line;
-      continue;
+      fprintf(stderr, "Malformed program: no program ending before the top of memory\n");
+      return -1;
     }
-    // print line number plus cursor
-    static const char* first_digit = " 123456789ABCDEFG"; // the first line digit can go up to G
-    char line_number[5];
-    snprintf(line_number, sizeof(line_number), "%c%3d", first_digit[line / 1000], line % 1000);
-    line_number[sizeof(line_number) - 1] = 0;
-    if (line_number[0] != ' ')
+    rom_list(buffer, start, table, width, show_cursor ? cursor : -1, &sink, &stats);
+  }
+  else
+  {
+    // a 0x76 marks the end of the program
+    while (peekb(buffer, current) != 0x76)
     {
-      if (line_number[1] == ' ')
+      // evaluate the next line
+      int next_line = current + (peekb(buffer, current + 2) | peekb(buffer, current + 3) << 8) + 4;
+      // get the line number
+      int line = peekw(buffer, current);
+      // listing ends if line number is >= 16384
+      if (line >= 16384)
       {
-        line_number[1] = '0';
+        break;
       }
-      if (line_number[2] == ' ')
+      // if line is less than the first line to list...
+      if (line < start)
       {
-        line_number[2] = '0';
+        // restart loop in the next line
+        current = next_line;
+        continue;
       }
-    }
-    fprintf(output, "%s%s", line_number, show_cursor && line == cursor ? table[0x92] : " ");
-    // the last character was a space
-    was_space = 1;
-    // the line number always occupies four characters
-    column = 4;
-    // skip the line number and line length
-    current += 4;
-    // repeat until the end of the line
-    while (peekb(buffer, current) != 0x76)
-    {
-      // 0x7e marks the start of floating-point constants
-      if (peekb(buffer, current) == 0x7e)
+      // print line number plus cursor
+      static const char* first_digit = " 123456789ABCDEFG"; // the first line digit can go up to G
+      char line_number[5];
+      snprintf(line_number, sizeof(line_number), "%c%3d", first_digit[line / 1000], line % 1000);
+      line_number[sizeof(line_number) - 1] = 0;
+      if (line_number[0] != ' ')
       {
-        // we skip it because the literal value to list follows the constant
-        current += 6;
+        if (line_number[1] == ' ')
+        {
+          line_number[1] = '0';
+        }
+        if (line_number[2] == ' ')
+        {
+          line_number[2] = '0';
+        }
+      }
+      const xltoken_t* mark = show_cursor && line == cursor ? table + 0x92 : table; // 0x00 is a space
+      sink_write(&sink, line_number, 4);
+      sink_write(&sink, mark->text, mark->size);
+      stats.chars += 4 + mark->size;
+      // the last character was a space
+      was_space = 1;
+      // the line number always occupies four characters
+      column = 4;
+      // skip the line number and line length
+      current += 4;
+      // repeat until the end of the line
+      while (peekb(buffer, current) != 0x76)
+      {
+        // 0x7e marks the start of floating-point constants
+        if (peekb(buffer, current) == 0x7e)
+        {
+          // we skip it because the literal value to list follows the constant
+          current += 6;
+        }
+        else
+        {
+          // output the character with the translation table
+          // print updates column and was_space
+          print(&sink, table + peekb(buffer, current), width, &column, &was_space, &stats);
+          // skip the character
+          current++;
+        }
+      }
+      // line ended, print a new line
+      sink_putc(&sink, '\n');
+      stats.lines++;
+      stats.chars++;
+      // restart column at 0
+      column = 0;
+      // go to the next line
+      if (full)
+      {
+        // for full listings we just go to the next line
+        current = next_line;
       }
       else
       {
-        // output the character with the translation table
-        // print updates column and was_space
-        print(output, table[peekb(buffer, current)], width, &column, &was_space);
-        // skip the character
+        // otherwise skip the 0x76 marking the end of the line
         current++;
       }
     }
-    // line ended, print a new line
-    fprintf(output, "\n");
-    // restart column at 0
-    column = 0;
-    // go to the next line
-    if (full)
-    {
-      // for full listings we just go to the next line
-      current = next_line;
-    }
-    else
-    {
-      // otherwise skip the 0x76 marking the end of the line
-      current++;
-    }
   }
   
+  stats.setup = now() - setup;
+  
   // all done, close output file and exit
+  double write = now();
+  sink.file = output;
+  if (sink_close(&sink) != 0)
+  {
+    fprintf(stderr, "Error writing output: %s\n", strerror(errno));
+    return -1;
+  }
   if (output != stdout)
   {
     fclose(output);
   }
+  else
+  {
+    fflush(output);
+  }
+  stats.write = now() - write;
+  if (show_stats)
+  {
+    print_stats(stderr, "ageplist", &stats, started, 0);
+  }
   return 0;
 }
@@ -0,0 +1,68 @@
+#!/bin/sh
+# Lists the P files of a directory with "ageplist -e" and with wmaplist,
+# with the same options, and fails on any difference in the listings or
+# in the exit status. The faster modes of wmaplist are checked against
+# wmaplist the same way. A listing the ROM stops, with exit status 2, is
+# one ageplist can't make, and is only checked in wmaplist.
+#
+# usage: diffcheck.sh ageplist wmaplist dir
+
+ageplist=$1
+wmaplist=$2
+dir=$3
+if [ -z "$dir" ]
+then
+  echo "usage: diffcheck.sh ageplist wmaplist dir" >&2
+  exit 1
+fi
+
+tmp=${TMPDIR:-/tmp}/diffcheck.$$
+trap 'rm -f "$tmp".ref "$tmp".out' EXIT
+
+files=0
+failed=0
+
+# compares the listing of "$@" with the one in $tmp.ref, which exited with
+# $ref, and counts the differences in failed
+compare()
+{
+  "$@" > "$tmp".out 2> /dev/null
+  out=$?
+  if [ $ref != $out ]
+  then
+    echo "$input $options: wmaplist exits with $ref, $1 $mode with $out"
+    failed=$((failed + 1))
+  elif ! cmp -s "$tmp".ref "$tmp".out
+  then
+    echo "$input $options: the listings of wmaplist and $1 $mode differ"
+    failed=$((failed + 1))
+  fi
+}
+
+for input in "$dir"/*.p "$dir"/*.P
+do
+  [ -f "$input" ] || continue
+  files=$((files + 1))
+  for options in "" "-c" "-z" "-w 20" "-w 1" "-s 10" "-s 9999" "-f" "-a" "-c -z -f -w 40"
+  do
+    "$wmaplist" $options "$input" > "$tmp".ref 2> /dev/null
+    ref=$?
+    if [ $ref != 2 ]
+    then
+      mode=-e
+      compare "$ageplist" -e $options "$input"
+    fi
+    mode=-n
+    compare "$wmaplist" -n $options "$input"
+    mode="-r 3"
+    compare "$wmaplist" -r 3 -j 2 $options "$input"
+  done
+done
+
+if [ $files = 0 ]
+then
+  echo "No P files in $dir" >&2
+  exit 1
+fi
+echo "$files files, $failed differences"
+[ $failed = 0 ]
@@ -0,0 +1,98 @@
+/*
+Generates the token tables used by the listers.
+
+This file is in public domain.
+
+usage: mkxltokens > xltokens.h
+
+Writes a C header to stdout with table_ascii and table_zx81 of
+xltables.h turned into arrays of tokens, each with its length and flags
+before its text:
+
+  XL_LEADING   the text starts with a space and has more after it, so
+               it can be left out after another space
+  XL_TRAILING  the text ends with a space
+
+so a token is copied whole with its length and the space rules are flag
+tests. The tables are made from the ones in xltables.h at each build, so
+they always agree.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "xltables.h"
+
+#define XL_LEADING 1
+#define XL_TRAILING 2
+
+// room for the text of a token and its NUL
+#define TEXTSIZE 14
+
+// the XL_ flags of the text s
+static int flags(const char* s)
+{
+  size_t size = strlen(s);
+  int f = 0;
+  if (s[0] == ' ' && size > 1)
+  {
+    f |= XL_LEADING;
+  }
+  if (size > 0 && s[size - 1] == ' ')
+  {
+    f |= XL_TRAILING;
+  }
+  return f;
+}
+
+// writes the table t as the array name, returns 1 if a text doesn't fit
+static int table(const char* name, const char** t)
+{
+  printf("static const xltoken_t %s[256] = {\n", name);
+  int i;
+  for (i = 0; i < 256; i++)
+  {
+    if (strlen(t[i]) >= TEXTSIZE)
+    {
+      fprintf(stderr, "mkxltokens: %s[0x%02x] is too long\n", name, i);
+      return 1;
+    }
+    printf("\t{ %d, %d, \"", (int)strlen(t[i]), flags(t[i]));
+    const unsigned char* s;
+    for (s = (const unsigned char*)t[i]; *s; s++)
+    {
+      if (*s == '"' || *s == '\\')
+      {
+        printf("\\%c", *s);
+      }
+      else if (*s < 0x20 || *s >= 0x7f)
+      {
+        printf("\\%03o", *s);
+      }
+      else
+      {
+        putchar(*s);
+      }
+    }
+    printf("\" },\t/* %02x */\n", i);
+  }
+  printf("};\n\n");
+  return 0;
+}
+
+int main(void)
+{
+  printf("/* generated by mkxltokens from xltables.h, do not edit */\n\n");
+  printf("#define XL_LEADING\t%d\n", XL_LEADING);
+  printf("#define XL_TRAILING\t%d\n\n", XL_TRAILING);
+  printf("typedef struct {\n");
+  printf("\tunsigned char size;\t/* length of text */\n");
+  printf("\tunsigned char flags;\t/* XL_ bits */\n");
+  printf("\tchar text[%d];\n", TEXTSIZE);
+  printf("} xltoken_t;\n\n");
+  if (table("tokens_ascii", table_ascii) || table("tokens_zx81", table_zx81))
+  {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,117 @@
+/*
+A buffer the listers write their output into.
+
+This file is in public domain.
+
+Text is appended to the buffer with memcpy, and the buffer is written
+to its file in large blocks when it is full. Without a file it grows to
+take the whole output, which can then be handed to whoever needs it.
+Errors are remembered and reported when the sink is closed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the size of the blocks written to a file
+#define SINK_BLOCK 65536
+
+typedef struct
+{
+  char* data;
+  size_t size;     // bytes in data
+  size_t capacity; // bytes allocated to data
+  FILE* file;      // where the output goes, NULL to keep it all in data
+  int error;       // set when the output couldn't be allocated or written
+} sink_t;
+
+// starts a sink writing to file, or keeping the output if file is NULL
+static inline void sink_init(sink_t* sink, FILE* file)
+{
+  sink->data = NULL;
+  sink->size = 0;
+  sink->capacity = 0;
+  sink->file = file;
+  sink->error = 0;
+}
+
+// writes the buffer to the file of the sink, if any
+static inline void sink_flush(sink_t* sink)
+{
+  if (sink->file != NULL && sink->size != 0)
+  {
+    if (fwrite(sink->data, 1, sink->size, sink->file) != sink->size)
+    {
+      sink->error = 1;
+    }
+    sink->size = 0;
+  }
+}
+
+// makes room for size more bytes, returns 0 if there isn't
+static inline int sink_room(sink_t* sink, size_t size)
+{
+  if (sink->size + size <= sink->capacity)
+  {
+    return 1;
+  }
+  if (sink->file != NULL)
+  {
+    sink_flush(sink);
+    if (size <= sink->capacity)
+    {
+      return 1;
+    }
+  }
+  size_t capacity = sink->capacity != 0 ? sink->capacity : SINK_BLOCK;
+  while (capacity < sink->size + size)
+  {
+    capacity *= 2;
+  }
+  char* data = (char*)realloc(sink->data, capacity);
+  if (data == NULL)
+  {
+    sink->error = 1;
+    return 0;
+  }
+  sink->data = data;
+  sink->capacity = capacity;
+  return 1;
+}
+
+static inline void sink_write(sink_t* sink, const char* text, size_t size)
+{
+  if (sink_room(sink, size))
+  {
+    memcpy(sink->data + sink->size, text, size);
+    sink->size += size;
+  }
+}
+
+static inline void sink_putc(sink_t* sink, int ch)
+{
+  if (sink->size < sink->capacity || sink_room(sink, 1))
+  {
+    sink->data[sink->size++] = ch;
+  }
+}
+
+// hands the output kept by a sink without a file to the caller, who
+// frees it, and empties the sink
+static inline char* sink_take(sink_t* sink, size_t* size)
+{
+  char* data = sink->data;
+  *size = sink->size;
+  sink_init(sink, sink->file);
+  return data;
+}
+
+// flushes the sink and frees its buffer, returns -1 if there were errors
+static inline int sink_close(sink_t* sink)
+{
+  sink_flush(sink);
+  free(sink->data);
+  int error = sink->error;
+  sink_init(sink, sink->file);
+  return error ? -1 : 0;
+}
@@ -0,0 +1,75 @@
+/*
+Timings and counts of a run, printed with --stats.
+
+This file is in public domain.
+
+The line printed is "stats" and then name=value pairs, with the times
+in seconds:
+
+  tool          the program that printed it
+  files         input files read
+  bytes         bytes read from them
+  load          reading the input
+  setup         setup_simulation in wmaplist, decoding the program in
+                ageplist, rendering the bitmap in zx81text
+  emulate       running the Z80, 0 but in wmaplist
+  write         writing the output
+  total         from the start of the program to the end
+  lines         lines output, or lines of text read in zx81text
+  chars         characters output, new lines included, or characters of
+                text read in zx81text, without the new lines
+  instructions  Z80 instructions run, in wmaplist only
+
+The times of several listings run in parallel are added up, so they can
+be more than the total.
+*/
+
+#include <time.h>
+
+typedef struct
+{
+  unsigned long files;
+  unsigned long long bytes;
+  double load;
+  double setup;
+  double emulate;
+  double write;
+  unsigned long lines;
+  unsigned long long chars;
+  unsigned long long instructions;
+} stats_t;
+
+// seconds from an arbitrary point
+static inline double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// adds the counts and the times of from to to
+static inline void add_stats(stats_t* to, const stats_t* from)
+{
+  to->files += from->files;
+  to->bytes += from->bytes;
+  to->load += from->load;
+  to->setup += from->setup;
+  to->emulate += from->emulate;
+  to->write += from->write;
+  to->lines += from->lines;
+  to->chars += from->chars;
+  to->instructions += from->instructions;
+}
+
+// prints the stats line of a run started at start, with the instructions
+// only for tools that emulate
+static inline void print_stats(FILE* out, const char* tool, const stats_t* stats, double start, int emulated)
+{
+  fprintf(out, "stats tool=%s files=%lu bytes=%llu load=%.6f setup=%.6f emulate=%.6f write=%.6f total=%.6f lines=%lu chars=%llu",
+    tool, stats->files, stats->bytes, stats->load, stats->setup, stats->emulate, stats->write, now() - start, stats->lines, stats->chars);
+  if (emulated)
+  {
+    fprintf(out, " instructions=%llu", stats->instructions);
+  }
+  fprintf(out, "\n");
+}
@@ -0,0 +1,354 @@
+/*
+The LIST command of the ZX-81 ROM, without the Z80.
+
+This file is in public domain.
+
+rom_list() goes through a program the way LIST-PROG and OUT-LINE do and
+prints the same characters, in the same order, with the same spaces, so
+its output is the same as wmaplist's. It needs zx81rom.h for the token
+table, and xltokens.h, sink.h and stats.h for the output.
+
+What wmaplist sets up for LIST and what it does with the characters is
+done here too: the E_PPC of the program gives the cursor only if it is
+asked for, and the characters are written with the translation table,
+starting a new line when the width is reached.
+
+The listing follows the program byte after byte as the ROM does, so a
+0x76 inside a line ends it there, and it ends where a line number is
+16384 or more. Memory is 64K of RAM at 0x4000 and up: a listing that
+would go past 0xFFFF and around to the ROM ends there instead.
+
+The lines can also be listed one at a time with rom_list_line(), and
+rom_list_risky() tells the lines no ZX-81 would have made, for a lister
+that wants the emulator to have the last word on those.
+*/
+
+// the first line of the program and the token table in the ROM
+#define ROM_LIST_PROG   0x407d
+#define ROM_LIST_TOKENS 0x0111
+
+// a listing as the ROM does it
+typedef struct
+{
+  const unsigned char* memory; // 64K with the P file loaded at 0x4009
+  const xltoken_t* table;
+  int width;       // characters per line of the output
+  int cursor;      // line shown with the cursor, -1 for none
+  sink_t* output;
+  stats_t* stats;  // where the lines and characters output are counted
+  int column;      // counted as wmaplist does, -1 at the start of a line
+  int suppress;    // bit 0 of FLAGS, no leading space in the next token
+  unsigned address; // CH_ADD
+} rom_list_t;
+
+static inline int rom_list_peek(const unsigned char* memory, unsigned address)
+{
+  // past the top of memory the listing is ended with a 0x76
+  return address < 0x10000 ? memory[address] : 0x76;
+}
+
+// starts a listing of memory, with the characters written to output
+static inline void rom_list_init(rom_list_t* list, const unsigned char* memory, const xltoken_t* table, int width, int cursor, sink_t* output, stats_t* stats)
+{
+  list->memory = memory;
+  list->table = table;
+  list->width = width;
+  list->cursor = cursor;
+  list->output = output;
+  list->stats = stats;
+  list->column = -1;
+  list->suppress = 0;
+  list->address = ROM_LIST_PROG;
+}
+
+// LINE-ADDR, the first line at or after start, found with the lengths of
+// the lines before it
+static inline unsigned rom_list_addr(const unsigned char* memory, int start)
+{
+  unsigned line = ROM_LIST_PROG;
+  while (line < 0x10000 && memory[line] < 0x40 && (memory[line] << 8 | rom_list_peek(memory, line + 1)) < (start & 0x3fff))
+  {
+    line += (rom_list_peek(memory, line + 2) | rom_list_peek(memory, line + 3) << 8) + 4;
+  }
+  return line;
+}
+
+// where OUT-LINE goes on after the line at line, past the first 0x76 that
+// is not in a number
+static inline unsigned rom_list_end(const unsigned char* memory, unsigned line)
+{
+  unsigned address = line + 4;
+  for (;;)
+  {
+    int ch = rom_list_peek(memory, address++);
+    if (ch == 0x7e)
+    {
+      address += 5;
+    }
+    else if (ch == 0x76)
+    {
+      return address;
+    }
+  }
+}
+
+// returns 1 if the line at line has what the ZX-81 doesn't put in the lines
+// it makes, so the line can't be listed without the ROM to prove it right:
+// a length that doesn't end at its 0x76, a number not after its digits, a
+// code that isn't a character or a keyword, the cursor, or a space next to
+// a keyword, where the spaces printed depend on FLAGS
+static inline int rom_list_risky(const unsigned char* memory, unsigned line)
+{
+  unsigned end = rom_list_end(memory, line);
+  if (end != line + 4 + (rom_list_peek(memory, line + 2) | rom_list_peek(memory, line + 3) << 8))
+  {
+    return 1;
+  }
+  int previous = 0x76; // nothing before the first character
+  unsigned address;
+  for (address = line + 4; address < end - 1; address++)
+  {
+    int ch = rom_list_peek(memory, address);
+    if (ch == 0x7e)
+    {
+      // a digit, a decimal point or the E of an exponent
+      if (!(previous >= 0x1b && previous <= 0x25) && previous != 0x2a)
+      {
+        return 1;
+      }
+      address += 5;
+    }
+    else if (ch >= 0x43 && ch < 0x80)
+    {
+      return 1;
+    }
+    else if ((ch == 0 && previous >= 0xc0) || (ch >= 0xc0 && previous == 0))
+    {
+      return 1;
+    }
+    previous = ch;
+  }
+  return 0;
+}
+
+// what ENTER-CH does with a character, as wmaplist outputs it
+static inline void rom_list_enter(rom_list_t* list, int ch)
+{
+  if (ch == 0x76)
+  {
+    sink_putc(list->output, '\n');
+    list->column = -1;
+    list->suppress = 1;
+    list->stats->lines++;
+    list->stats->chars++;
+    return;
+  }
+  if (++list->column == list->width)
+  {
+    sink_putc(list->output, '\n');
+    list->column = 0;
+    list->stats->lines++;
+    list->stats->chars++;
+  }
+  const xltoken_t* token = list->table + ch;
+  sink_write(list->output, token->text, token->size);
+  list->stats->chars += token->size;
+}
+
+// PRINT-CH, which allows a leading space again
+static inline void rom_list_print_ch(rom_list_t* list, int ch)
+{
+  list->suppress = 0;
+  rom_list_enter(list, ch);
+}
+
+// PRINT-A, where a space goes to PRINT-SP and leaves FLAGS alone
+static inline void rom_list_print_a(rom_list_t* list, int ch)
+{
+  if (ch == 0)
+  {
+    rom_list_enter(list, ch);
+  }
+  else
+  {
+    rom_list_print_ch(list, ch);
+  }
+}
+
+// TOKENS and TOKEN-ADD
+static inline void rom_list_token(rom_list_t* list, int code)
+{
+  int a = code & 0x80 ? code & 0x3f : code;
+  unsigned address = ROM_LIST_TOKENS;
+  int leading = 0;
+  // codes from 0x43 up have the first entry, a question mark
+  if (a < 0x43)
+  {
+    int i;
+    for (i = 0; i <= a; i++)
+    {
+      while (!(rom[address++] & 0x80))
+      {
+      }
+    }
+    // keywords that start with a letter or a digit after RND, INKEY$ and PI
+    leading = !(a & 0x40) && a >= 0x18 && rom[address] >= 0x1c;
+  }
+  if (leading && !list->suppress)
+  {
+    rom_list_enter(list, 0);
+  }
+  int ch;
+  do
+  {
+    ch = rom[address++];
+    rom_list_print_a(list, ch & 0x3f);
+  }
+  while (!(ch & 0x80));
+  // keywords ending with a letter, a digit or a $ have a trailing space
+  int last = (ch << 1) & 0xff;
+  if ((code & 0x80) && (last == 0x1a || last >= 0x38))
+  {
+    list->suppress = 1;
+    rom_list_enter(list, 0);
+  }
+}
+
+// OUT-LINE, returns 0 at the end of the listing
+static inline int rom_list_line(rom_list_t* list, unsigned line)
+{
+  if (rom_list_peek(list->memory, line) >= 0x40)
+  {
+    return 0;
+  }
+  int number = rom_list_peek(list->memory, line) << 8 | rom_list_peek(list->memory, line + 1);
+  // OUT-NUM-1, the leading zeros are spaces
+  static const int powers[3] = { 1000, 100, 10 };
+  int e = 0;
+  int i;
+  for (i = 0; i < 3; i++)
+  {
+    int digit = number / powers[i];
+    number %= powers[i];
+    if (digit != 0)
+    {
+      e = 0x1c;
+      rom_list_print_ch(list, digit + 0x1c);
+    }
+    else
+    {
+      rom_list_print_ch(list, e);
+    }
+  }
+  rom_list_print_ch(list, number + 0x1c);
+  // the cursor or a space
+  rom_list_print_a(list, list->cursor == (rom_list_peek(list->memory, line) << 8 | rom_list_peek(list->memory, line + 1)) ? 0x92 : 0);
+  list->address = line + 4;
+  list->suppress = 1;
+  for (;;)
+  {
+    // the syntax error marker is never printed, as running LIST clears X_PTR
+    int ch = rom_list_peek(list->memory, list->address++);
+    if (ch == 0x7e)
+    {
+      // the number follows its text
+      list->address += 5;
+    }
+    else if (ch == 0x7f)
+    {
+      // the K cursor, as MODE is 0 and FLAGS has no L mode
+      rom_list_enter(list, 0xb0);
+    }
+    else if (ch == 0x76)
+    {
+      rom_list_print_ch(list, ch);
+      return 1;
+    }
+    else if (ch & 0x40)
+    {
+      rom_list_token(list, ch);
+    }
+    else
+    {
+      rom_list_print_a(list, ch);
+    }
+  }
+}
+
+// moves a byte of the program down in rom_list_full(), returns -1 if the
+// target is at the top of memory, as lines that go back make it grow
+static inline int rom_list_move(unsigned char* memory, unsigned* target, unsigned* current)
+{
+  if (*target >= 0x10000)
+  {
+    return -1;
+  }
+  memory[(*target)++] = memory[(*current)++];
+  return 0;
+}
+
+// takes out the spurious program endings, 0x76 0x76 inside lines, the way
+// wmaplist -f does before listing, returns -1 if the program has no ending
+// before the top of memory
+static inline int rom_list_full(unsigned char* memory)
+{
+  unsigned current = ROM_LIST_PROG; // address of first line
+  unsigned target = current;        // target position
+  int i;
+  while (current < 0x10000 && memory[current] != 0x76)
+  {
+    // evaluate the next line
+    unsigned next_line = current + (rom_list_peek(memory, current + 2) | rom_list_peek(memory, current + 3) << 8) + 4;
+    // copy the line number and the line length to target
+    for (i = 0; i < 4 && current < 0x10000; i++)
+    {
+      if (rom_list_move(memory, &target, &current) != 0)
+      {
+        return -1;
+      }
+    }
+    // repeat until the end of the line
+    while (current < 0x10000 && memory[current] != 0x76)
+    {
+      // 0x7e marks the start of floating-point constants
+      int count = memory[current] == 0x7e ? 6 : 1;
+      for (i = 0; i < count && current < 0x10000; i++)
+      {
+        if (rom_list_move(memory, &target, &current) != 0)
+        {
+          return -1;
+        }
+      }
+    }
+    // copy the end of line
+    if (current >= 0x10000 || rom_list_move(memory, &target, &current) != 0)
+    {
+      return -1;
+    }
+    // check for spurious line endings
+    if (current < 0x10000 && memory[current] == 0x76 && current != next_line)
+    {
+      current = next_line;
+    }
+  }
+  if (current >= 0x10000 || target >= 0x10000)
+  {
+    return -1;
+  }
+  // add the program ending
+  memory[target] = 0x76;
+  return 0;
+}
+
+// LIST start, writes the listing to output
+static inline void rom_list(const unsigned char* memory, int start, const xltoken_t* table, int width, int cursor, sink_t* output, stats_t* stats)
+{
+  rom_list_t list;
+  rom_list_init(&list, memory, table, width, cursor, output, stats);
+  // LIST-PROG, each line starts after the end of the one before
+  unsigned line = rom_list_addr(memory, start);
+  while (rom_list_line(&list, line))
+  {
+    line = list.address;
+  }
+}
@@ -0,0 +1,152 @@
+/*
+Names of the ZX-81 ROM routines.
+
+This file is in public domain.
+
+The names and addresses follow the usual disassembly of the ROM in
+zx81rom.h. Each entry is where a routine starts, and the table is in
+address order, so an address belongs to the last entry at or below it.
+The data tables have entries too, so their bytes are not counted
+in the routine before them.
+*/
+
+typedef struct
+{
+  uint16_t address;
+  const char* name;
+} rom_symbol_t;
+
+static const rom_symbol_t rom_symbols[] =
+{
+  { 0x0000, "START" },
+  { 0x0008, "ERROR-1" },
+  { 0x0010, "PRINT-A" },
+  { 0x0018, "GET-CHAR" },
+  { 0x001C, "TEST-SP" },
+  { 0x0020, "NEXT-CHAR" },
+  { 0x0028, "FP-CALC" },
+  { 0x002B, "END-CALC" },
+  { 0x0030, "BC-SPACES" },
+  { 0x0038, "INTERRUPT" },
+  { 0x0041, "WAIT-INT" },
+  { 0x0045, "SCAN-LINE" },
+  { 0x0049, "CH-ADD+1" },
+  { 0x0066, "NMI" },
+  { 0x007E, "K-UNSHIFT" },
+  { 0x0111, "TOKENS-TABLE" },
+  { 0x01FC, "LOAD-SAVE" },
+  { 0x0207, "SLOW/FAST" },
+  { 0x0229, "DISPLAY-1" },
+  { 0x0281, "DISPLAY-3" },
+  { 0x0292, "DISPLAY-4" },
+  { 0x02B5, "DISPLAY-5" },
+  { 0x02BB, "KEYBOARD" },
+  { 0x02E7, "SET-FAST" },
+  { 0x02F6, "SAVE" },
+  { 0x031E, "OUT-BYTE" },
+  { 0x0340, "LOAD" },
+  { 0x03A8, "NAME" },
+  { 0x03C3, "NEW" },
+  { 0x03CB, "RAM-CHECK" },
+  { 0x0676, "NEXT-LINE" },
+  { 0x072C, "LLIST" },
+  { 0x0730, "LIST" },
+  { 0x073E, "LIST-PROG" },
+  { 0x0745, "OUT-LINE" },
+  { 0x07BD, "DECODE" },
+  { 0x07EB, "OUT-CH" },
+  { 0x07F1, "PRINT-CH" },
+  { 0x07F5, "PRINT-SP" },
+  { 0x0808, "ENTER-CH" },
+  { 0x0851, "LPRINT-CH" },
+  { 0x0869, "COPY" },
+  { 0x0918, "LOC-ADDR" },
+  { 0x094B, "TOKENS" },
+  { 0x0975, "TOKEN-ADD" },
+  { 0x099E, "MAKE-ROOM" },
+  { 0x09AD, "POINTERS" },
+  { 0x09D8, "LINE-ADDR" },
+  { 0x09EA, "CP-LINES" },
+  { 0x09F2, "NEXT-ONE" },
+  { 0x0A2A, "CLS" },
+  { 0x0A5D, "RECLAIM-1" },
+  { 0x0A60, "RECLAIM-2" },
+  { 0x0A73, "E-LINE-NO" },
+  { 0x0A98, "OUT-NUM" },
+  { 0x0AA5, "OUT-NUM-1" },
+  { 0x0ACF, "PRINT" },
+  { 0x0BAF, "PLOT/UNP" },
+  { 0x0CBA, "LINE-SCAN" },
+  { 0x0CDC, "STOP" },
+  { 0x0CDE, "IF" },
+  { 0x0D92, "CLASS-6" },
+  { 0x0DA6, "SYNTAX-Z" },
+  { 0x0EA7, "FIND-INT" },
+  { 0x0EC5, "TEST-ROOM" },
+  { 0x0F32, "PAUSE" },
+  { 0x0F46, "BREAK-1" },
+  { 0x0F55, "SCANNING" },
+  { 0x111C, "LOOK-VARS" },
+  { 0x13F8, "STK-FETCH" },
+  { 0x14D9, "DEC-TO-FP" },
+  { 0x151D, "STACK-A" },
+  { 0x1520, "STACK-BC" },
+  { 0x155A, "E-TO-FP" },
+  { 0x158A, "FP-TO-BC" },
+  { 0x15CD, "FP-TO-A" },
+  { 0x15DB, "PRINT-FP" },
+  { 0x174C, "SUBTRACT" },
+  { 0x1755, "ADDITION" },
+  { 0x17C6, "MULTIPLY" },
+  { 0x1882, "DIVISION" },
+  { 0x18E4, "TRUNCATE" },
+  { 0x1915, "STK-ZERO" },
+  { 0x1923, "TBL-ADDRS" },
+  { 0x199D, "CALCULATE" },
+  { 0x19E3, "DELETE" },
+  { 0x19E4, "FP-CALC-2" },
+  { 0x19EB, "TEST-5-SP" },
+  { 0x19F6, "MOVE-FP" },
+  { 0x19FC, "STK-DATA" },
+  { 0x1A45, "GET-MEM-XX" },
+  { 0x1A51, "STK-CONST-XX" },
+  { 0x1A63, "ST-MEM-XX" },
+  { 0x1A72, "EXCHANGE" },
+  { 0x1A7F, "SERIES-XX" },
+  { 0x1AA0, "NEGATE" },
+  { 0x1AAA, "ABS" },
+  { 0x1AAF, "SGN" },
+  { 0x1ABE, "PEEK" },
+  { 0x1AC5, "USR-NO" },
+  { 0x1ACE, "GREATER-0" },
+  { 0x1AD5, "NOT" },
+  { 0x1ADB, "LESS-0" },
+  { 0x1AED, "OR" },
+  { 0x1AF3, "NO-&-NO" },
+  { 0x1AF8, "STR-&-NO" },
+  { 0x1B03, "NO-L-EQL" },
+  { 0x1B62, "STRS-ADD" },
+  { 0x1B85, "STK-PNTRS" },
+  { 0x1B8F, "CHRS" },
+  { 0x1BA4, "VAL" },
+  { 0x1BD5, "STR$" },
+  { 0x1C06, "CODE" },
+  { 0x1C11, "LEN" },
+  { 0x1C17, "DEC-JR-NZ" },
+  { 0x1C23, "JUMP" },
+  { 0x1C2F, "JUMP-TRUE" },
+  { 0x1C37, "N-MOD-M" },
+  { 0x1C46, "INT" },
+  { 0x1C5B, "EXP" },
+  { 0x1CA9, "LN" },
+  { 0x1D18, "GET-ARGT" },
+  { 0x1D3E, "COS" },
+  { 0x1D49, "SIN" },
+  { 0x1D6E, "TAN" },
+  { 0x1D76, "ATN" },
+  { 0x1DC4, "ASN" },
+  { 0x1DD4, "ACS" },
+  { 0x1DDB, "SQR" },
+  { 0x1DE2, "TO-POWER" },
+  { 0x1E00, "CHAR-SET" },
+};
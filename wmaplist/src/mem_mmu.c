@@ -23,14 +23,132 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA. */
 #include <sys/stat.h>
 
 #include "mem_mmu.h"
+#include "simz80.h"		/* for the definitions of the Z80 registers */
 
 
-BYTE ram[MEMSIZE*1024];		/* the whole memory space */
+/*------------------------------------------- addwatch -----------------
+  calls hook after every write to the addresses first to last of machine
+  m, returns -1 if there are already MAXWATCHES watches */
+int
+addwatch(machine_struct *m, WORD first, WORD last, watchhook hook)
+{
+    int p;
+
+    if (m->nwatches == MAXWATCHES)
+	return -1;
+    m->watches[m->nwatches].first = first;
+    m->watches[m->nwatches].last = last;
+    m->watches[m->nwatches].hook = hook;
+    m->nwatches++;
+    for (p = first>>WATCHSHIFT; p <= last>>WATCHSHIFT; p++)
+	m->watchpage[p]++;
+    return 0;
+} /* END of addwatch */
+
+/*------------------------------------------- clearwatches -------------*/
+void
+clearwatches(machine_struct *m)
+{
+    memclr(m->watchpage, sizeof(m->watchpage));
+    m->nwatches = 0;
+} /* END of clearwatches */
+
+/*------------------------------------------- callwatch ----------------
+  called after a write to a watched page, returns non-zero if a hook
+  asked simz80_run to stop */
+int
+callwatch(machine_struct *m, WORD addr, BYTE value)
+{
+    int w, stop = 0;
+
+    for (w=0; w<m->nwatches; w++)
+	if (m->watches[w].first <= addr && addr <= m->watches[w].last)
+	    stop |= m->watches[w].hook(m, addr, value);
+    return stop;
+} /* END of callwatch */
+
+/*------------------------------------------- markdirty ----------------
+  marks the pages of first to last as written, for the writes to the
+  memory of m that are not made by simz80_run */
+void
+markdirty(machine_struct *m, WORD first, WORD last)
+{
+    unsigned int p;
+
+    for (p=first>>DIRTYSHIFT; p<=(unsigned int)last>>DIRTYSHIFT; p++)
+	m->dirtypage[p] = 1;
+} /* END of markdirty */
+
+/*------------------------------------------- resetdirty ---------------
+  copies the pages written since the last reset back from image, which
+  must be what the memory of m was then, and clears the dirty pages; the
+  pages are where the map sends their writes, ROM pages have nothing
+  to put back */
+void
+resetdirty(machine_struct *m, const BYTE *image)
+{
+    unsigned int p;
+
+    for (p=0; p<DIRTYPAGES; p++)
+	if (m->dirtypage[p]) {
+#ifdef MMU
+	    memcpy(m->ram + (p<<DIRTYSHIFT), image + (p<<DIRTYSHIFT),
+		   1<<DIRTYSHIFT);
+#else
+	    BYTE *page = m->wpage[p>>(MAPSHIFT-DIRTYSHIFT)];
+
+	    if (page != m->sink) {
+		page += (p<<DIRTYSHIFT) & MAPMASK;
+		memcpy(page, image + (page - m->ram), 1<<DIRTYSHIFT);
+	    }
+#endif
+	    m->dirtypage[p] = 0;
+	}
+} /* END of resetdirty */
+
+#ifndef MMU
+/*------------------------------------------- mapmemory ----------------
+  maps the memory of m: from 0 the romsize bytes of rom, repeated up to
+  ramstart and written to a sink, then the ramsize bytes at m->ram from
+  ramstart, repeated up to the top. Without rom the pages below ramstart
+  read and write the sink. Sizes are multiples of the 1 KByte pages. */
+void
+mapmemory(machine_struct *m, const BYTE *rom, unsigned int romsize,
+	  unsigned int ramstart, unsigned int ramsize)
+{
+    m->rom = rom;
+    m->romsize = romsize;
+    m->ramstart = ramstart;
+    m->ramsize = ramsize;
+    remapmemory(m);
+} /* END of mapmemory */
+
+/*------------------------------------------- remapmemory --------------
+  sets the page pointers from the map of m again, for a machine copied
+  from another one */
+void
+remapmemory(machine_struct *m)
+{
+    unsigned int p, a;
+
+    for (p=0; p<MAPPAGES; p++) {
+	a = p<<MAPSHIFT;
+	if (a < m->ramstart) {
+	    m->rpage[p] = m->rom == NULL ? m->sink :
+		(BYTE *) m->rom + a % m->romsize;
+	    m->wpage[p] = m->sink;
+	}
+	else
+	    m->rpage[p] = m->wpage[p] =
+		m->ram + (a - m->ramstart) % m->ramsize;
+    }
+} /* END of remapmemory */
+#endif
 
 
 #ifdef MMU /* <------------------------- only if MMU is selected ------------ */
 
-#include "simz80.h"		/* for the definitions of the Z80 registers */
+BYTE ram[MEMSIZE*1024];		/* the whole memory space */
 
 pagetab_struct MMUtable[MMUTABLES];	/* MMU page tables (default 8)        */
 pagetab_struct *mmu;		       /* Pointer to selected MMU-pagetable  */
@@ -143,11 +261,11 @@ initMMU()
 */
 
 /* Z80 registers */
-#define AF	af[af_sel]
-#define HL	regs[regs_sel].hl
+#define AF	m->af[m->af_sel]
+#define HL	m->regs[m->regs_sel].hl
 
 void
-loadMMU()
+loadMMU(machine_struct *m)
 {
     static pagetab_struct * p_mmu;
     static int i,h_mmut,page;
@@ -60,7 +60,11 @@ typedef unsigned long	FASTWORK;
  #endif
 #endif
 
+#ifdef MMU
 extern BYTE ram[MEMSIZE*1024];	/* RAM which is present */
+#endif
+/* without MMU the macros below use the memory map in scope, normally
+   the one of the machine being simulated (see simz80.h) */
 
 /*---------------------------------- definitions for MMU tables --------*/
 
@@ -128,19 +132,85 @@ extern BYTE ram[MEMSIZE*1024];	/* RAM which is present */
  #define mm_MRAM(xmmu,a) *((xmmu->page[(((--a)&0xffff)>>12)]) + ((a)&0x0fff) )
 
 #else
- /* ram access without MMU, like Version 1.05/1.06/1.10 */
- #define RAM(a)		 ram[(a)&0xffff]
- #define MRAM(xmmu,a)	 ram[(a)&0xffff]
+ /* Without MMU the 64 KByte are a map of 1 KByte pages set up by
+    mapmemory(), with a pointer to read each page, rpage, and one to
+    write it, wpage. ROM pages share one image and are written to a sink,
+    and the RAM, only as big as configured, repeats over its area. */
+ #define MAPSHIFT 10
+ #define MAPPAGES (Z80MEMSIZE*1024 >> MAPSHIFT)
+ #define MAPMASK ((1 << MAPSHIFT) - 1)
+
+ /* the byte of a in the map, a is used once */
+ static inline BYTE *
+ mapbyte(BYTE *const *page, FASTREG a)
+ {
+	return page[(a&0xffff)>>MAPSHIFT] + (a&MAPMASK);
+ }
+
+ #define RAM(a)		 (*mapbyte(rpage, a))
+ #define WRAM(a)	 (*mapbyte(wpage, a))
+ #define MRAM(xmmu,a)	 RAM(a)
+
+ #define RAM_pp(a)	 (*mapbyte(rpage, a++))
+ #define MRAM_pp(xmmu,a) RAM_pp(a)
+
+ #define RAM_mm(a)	 (*mapbyte(rpage, a--))
+ #define MRAM_mm(xmmu,a) RAM_mm(a)
+
+ #define mm_RAM(a)	 (*mapbyte(rpage, --a))
+ #define mm_MRAM(xmmu,a) mm_RAM(a)
+
+ /* the byte of the RAM of machine m seen at address a, for the code
+    outside the simulation */
+ #define RAMBYTE(m, a)	 ((m)->ram[((a) - (m)->ramstart) % (m)->ramsize])
+#endif
+
+#ifdef MMU
+ #define WRAM(a)	 RAM(a)
+#endif
 
- #define RAM_pp(a)	 ram[(a++)&0xffff]
- #define MRAM_pp(xmmu,a) ram[(a++)&0xffff]
+/*------------------------------------ definitions for write watching --*/
 
- #define RAM_mm(a)	 ram[(a--)&0xffff]
- #define MRAM_mm(xmmu,a) ram[(a--)&0xffff]
+/* A write watch calls hook after a byte in [first, last] is written. Each
+   page of 16 bytes has a counter of the watches that cover it, so writes
+   to unwatched pages only cost a table lookup. Pages are small so that
+   busy system variables next to watched ones don't call the hooks for
+   nothing. When the hook returns non-zero simz80_run() returns after the
+   current instruction. watchpage, memhook and m are taken from the scope
+   of the caller. */
+
+#define WATCHSHIFT 4
+#define WATCHPAGES (Z80MEMSIZE*1024 >> WATCHSHIFT)
+#define MAXWATCHES 8
+
+struct machine_struct;
+
+typedef int (*watchhook)(struct machine_struct *m, WORD addr, BYTE value);
+
+typedef struct {
+	WORD first;
+	WORD last;
+	watchhook hook;
+} watch_struct;
+
+#define WATCH(a, v)							\
+    do { if (watchpage[((a)&0xffff)>>WATCHSHIFT])			\
+	    memhook |= callwatch(m, (a)&0xffff, v);			\
+    } while (0)
+
+/*------------------------------------- definitions for dirty pages --*/
+
+/* Each page of 256 bytes has a byte set when it is written, so a machine
+   reused for many programs can be put back to a baseline image copying
+   only the pages that changed, see resetdirty(). A byte rather than a bit
+   per page makes the mark a single store. dirtypage is taken from the
+   scope of the caller. */
+
+#define DIRTYSHIFT 8
+#define DIRTYPAGES (Z80MEMSIZE*1024 >> DIRTYSHIFT)
+
+#define DIRTY(a)	(dirtypage[((a)&0xffff)>>DIRTYSHIFT] = 1)
 
- #define mm_RAM(a)	 ram[(--a)&0xffff]
- #define mm_MRAM(xmmu,a) ram[(--a)&0xffff]
-#endif
 
 /* Some important macros. They are the interface between an access from
    the simz80-/yaze-Modules and the method of the memory access: */
@@ -149,9 +219,15 @@ extern BYTE ram[MEMSIZE*1024];	/* RAM which is present */
 #define GetBYTE_pp(a)	RAM_pp(a)
 #define GetBYTE_mm(a)	RAM_mm(a)
 #define mm_GetBYTE(a)	mm_RAM(a)
-#define PutBYTE(a, v)	RAM(a) = v
-#define PutBYTE_pp(a,v)	RAM_pp(a) = v
-#define PutBYTE_mm(a,v)	RAM_mm(a) = v
+#define PutBYTE(a, v)							\
+    do { FASTREG wa = (a);						\
+	 BYTE wv = (v);							\
+	 WRAM(wa) = wv;							\
+	 DIRTY(wa);							\
+	 WATCH(wa, wv);							\
+     } while (0)
+#define PutBYTE_pp(a,v)	do { PutBYTE(a, v); (a)++; } while (0)
+#define PutBYTE_mm(a,v)	do { PutBYTE(a, v); (a)--; } while (0)
 #define GetWORD(a)	(RAM(a) | (RAM((a)+1) << 8))
 
 /* don't work: #define GetWORD_pppp(a)	(RAM_pp(a) + (RAM_pp(a) << 8)) */
@@ -162,8 +238,8 @@ extern BYTE ram[MEMSIZE*1024];	/* RAM which is present */
  */
 
 #define PutWORD(a, v)							\
-    do { RAM(a) = (BYTE)(v);						\
-	 RAM((a)+1) = (v) >> 8;						\
+    do { PutBYTE(a, (BYTE)(v));						\
+	 PutBYTE((a)+1, (v) >> 8);					\
      } while (0)
 
 
@@ -245,3 +321,13 @@ void initMEM();
 void initMMU();
 void loadMMU();
 void printMMU();
+int addwatch(struct machine_struct *m, WORD first, WORD last, watchhook hook);
+void clearwatches(struct machine_struct *m);
+int callwatch(struct machine_struct *m, WORD addr, BYTE value);
+void markdirty(struct machine_struct *m, WORD first, WORD last);
+#ifndef MMU
+void mapmemory(struct machine_struct *m, const BYTE *rom, unsigned int romsize,
+	       unsigned int ramstart, unsigned int ramsize);
+void remapmemory(struct machine_struct *m);
+#endif
+void resetdirty(struct machine_struct *m, const BYTE *image);
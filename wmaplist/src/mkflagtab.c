@@ -0,0 +1,74 @@
+/* mkflagtab - generates the flag lookup tables used by simz80.c
+
+   Writes a C header to stdout with the Z80 flag bits that the
+   arithmetic and logic instructions would otherwise compute bit by bit
+   from their result:
+
+	sztab[r]	S, Z and the undocumented bits 5 and 3 of a result r
+	szptab[r]	the same plus the parity in P/V (logic ops, shifts)
+	inctab[r]	all flags but C after an INC giving r
+	dectab[r]	all flags but C after a DEC giving r
+	cbitstab[c]	H, V and C from the carry bits c = a ^ b ^ (a op b)
+			of an 8-bit add or subtract, c masked to 9 bits
+
+   The results are the same expressions simz80.c used inline, so the
+   tables can replace them one to one. */
+
+#include <stdio.h>
+
+static int sz(int r)
+{
+	return (r & 0xa8) | ((r == 0) << 6);
+}
+
+static int parity(int r)
+{
+	int p = 4;
+
+	while (r) {
+		p ^= (r & 1) << 2;
+		r >>= 1;
+	}
+	return p;
+}
+
+static int szp(int r)
+{
+	return sz(r) | parity(r);
+}
+
+static int inc(int r)
+{
+	return sz(r) | (((r & 0xf) == 0) << 4) | ((r == 0x80) << 2);
+}
+
+static int dec(int r)
+{
+	return sz(r) | (((r & 0xf) == 0xf) << 4) | ((r == 0x7f) << 2) | 2;
+}
+
+static int cbits(int c)
+{
+	return (c & 0x10) | (((c >> 6) ^ (c >> 5)) & 4) | ((c >> 8) & 1);
+}
+
+static void table(const char *name, int size, int (*f)(int))
+{
+	int i;
+
+	printf("static const unsigned char %s[%d] = {\n", name, size);
+	for (i = 0; i < size; i++)
+		printf("%s0x%02x,%s", i % 16 ? "" : "\t", f(i), i % 16 == 15 ? "\n" : "");
+	printf("};\n\n");
+}
+
+int main(void)
+{
+	printf("/* generated by mkflagtab, do not edit */\n\n");
+	table("sztab", 256, sz);
+	table("szptab", 256, szp);
+	table("inctab", 256, inc);
+	table("dectab", 256, dec);
+	table("cbitstab", 512, cbits);
+	return 0;
+}
@@ -0,0 +1,449 @@
+/* mkromaot - translates the ZX81 ROM into C for simz80.c
+
+   usage: mkromaot simz80.c > romaot.h
+
+   The ROM in zx81rom.h is walked from its restart and interrupt
+   addresses following jumps and calls, and every instruction found is
+   written out as a case of a switch on PC. The code of each case is
+   the interpreter's own code for that opcode, taken from simz80.c, so
+   the semantics are the same by construction; only the dispatch goes
+   away and the operands become constants the compiler can fold, as
+   they are read from a copy of the ROM (see AOT_BYTE in simz80.c).
+
+   Straight-line code falls through from one case to the next. Every
+   jump, call and return goes back to simz80_run(), which checks the
+   breakpoints and enters the translated code again if the target is
+   translated too. Opcodes the interpreter only handles in its default
+   cases (undefined ED and DD/FD ones) are not translated, and neither
+   is any code in RAM; simz80_run() interprets them.
+
+   With AOT_TABLES defined, romaot.h gives instead the ROM image the
+   translation was made from, a bitmap with the translated addresses,
+   and the runs of instructions that fall through into each other, so
+   simz80_aot() can enable only the runs the machine has not patched. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "zx81rom.h"
+
+#define ROMSIZE	8192
+
+/* the source of simz80.c, one string per line */
+static char **line;
+static int nlines;
+
+/* first and last lines of the code of each opcode, 0 if not found */
+typedef struct {
+	int first, last;
+} body_struct;
+
+static body_struct top[256], ed[256], idx[256];
+
+static unsigned char translated[ROMSIZE];
+static unsigned char length[ROMSIZE];
+
+static void
+fail(const char *msg)
+{
+	fprintf(stderr, "mkromaot: %s\n", msg);
+	exit(1);
+}
+
+static void
+readsource(const char *name)
+{
+	FILE *f = fopen(name, "r");
+	char buf[1024];
+	int size = 0;
+
+	if (f == NULL)
+		fail("can't open the simz80.c source");
+	while (fgets(buf, sizeof(buf), f) != NULL) {
+		if (nlines == size) {
+			size = size ? size * 2 : 4096;
+			line = realloc(line, size * sizeof(char *));
+			if (line == NULL)
+				fail("out of memory");
+		}
+		buf[strcspn(buf, "\n")] = 0;
+		line[nlines++] = strdup(buf);
+	}
+	fclose(f);
+}
+
+static int
+find(int from, int to, const char *text)
+{
+	int i;
+
+	for (i = from; i < to; i++)
+		if (strcmp(line[i], text) == 0)
+			return i;
+	fail("unexpected simz80.c layout");
+	return -1;
+}
+
+/* collects the code of the cases between lines from and to, the labels
+   being the lines starting with prefix; consecutive labels share the
+   code, which must end with one of the statements leaving the case */
+static void
+cases(body_struct *body, int from, int to, const char *prefix)
+{
+	int pending[256], npending = 0;
+	int i, j, content = 0;
+	size_t n = strlen(prefix);
+
+	for (i = from; i <= to; i++) {
+		int label = i < to && strncmp(line[i], prefix, n) == 0;
+
+		if ((label || i == to) && content) {
+			const char *last = line[i - 1] + strspn(line[i - 1], "\t ");
+
+			if (strcmp(last, "NEXT;") && strcmp(last, "break;") &&
+			    strncmp(last, "goto ", 5) && strncmp(last, "return", 6))
+				fail("a case falls through into another one");
+			for (j = 0; j < npending; j++)
+				body[pending[j]].last = i - 1;
+			npending = content = 0;
+		}
+		if (label) {
+			int op = (int) strtol(line[i] + n, NULL, 16);
+
+			pending[npending++] = op;
+			body[op].first = i + 1;
+		}
+		else if (npending) {
+			content = 1;
+			/* the code starts after the last label of a group */
+			for (j = 0; j < npending; j++)
+				body[pending[j]].first = body[pending[npending - 1]].first;
+		}
+	}
+}
+
+static void
+parse(void)
+{
+	int start, end, i;
+
+	start = find(0, nlines, "\tCASE(0x00):\t\t\t/* NOP */");
+	for (end = start; end < nlines && strcmp(line[end], "    }"); end++)
+		;
+	cases(top, start, end, "\tCASE(");
+	/* the ED opcodes, up to their default case */
+	i = top[0xed].first;
+	cases(ed, i, find(i, top[0xed].last, "\t\tDEFAULT(ed): if (0x40 <= op && op <= 0x7f) PC--;\t\t/* ignore ED */"), "\t\tEDCASE(0x");
+	/* the DD and FD opcodes, shared after the indexed label */
+	i = find(top[0xfd].first, top[0xfd].last, "\tindexed:\t\t\t/* DD and FD share the code, on XY */") + 2;
+	cases(idx, i, find(i, top[0xfd].last, "\t\tDEFAULT(xy): PC--;\t\t/* ignore DD/FD */"), "\t\tXYCASE(0x");
+}
+
+/* instruction lengths, with x, y and z the fields of the opcode */
+static int
+oplen(int op)
+{
+	int x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+
+	if (x == 0) {
+		if (z == 0)
+			return y < 2 ? 1 : 2;
+		if (z == 1)
+			return y & 1 ? 1 : 3;
+		if (z == 2)
+			return y < 4 ? 1 : 3;
+		return z == 6 ? 2 : 1;
+	}
+	if (x < 3)
+		return 1;
+	switch (z) {
+	case 2: case 4:
+		return 3;
+	case 3:
+		return y == 0 ? 3 : y <= 3 ? 2 : 1;
+	case 5:
+		return y == 1 ? 3 : 1;
+	case 6:
+		return 2;
+	}
+	return 1;
+}
+
+/* does an indexed opcode use (IX+dd)? */
+static int
+usesdisp(int op)
+{
+	int x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+
+	if (op >= 0x34 && op <= 0x36)
+		return 1;
+	if (x == 1)
+		return op != 0x76 && (y == 6 || z == 6);
+	return x == 2 && z == 6;
+}
+
+/* decodes the instruction at a; returns its length, 0 if it is not
+   translated, and sets the jump target and whether it can go on to the
+   next instruction */
+static int
+decode(int a, int *target, int *next)
+{
+	int op = rom[a], op2 = rom[(a + 1) % ROMSIZE];
+	int x = op >> 6, z = op & 7;
+
+	*target = -1;
+	*next = 1;
+	if (op == 0xed) {
+		if (!ed[op2].first)
+			return 0;
+		if ((op2 & 0xc7) == 0x45)	/* RETN, RETI */
+			*next = 0;
+		return (op2 & 0xc7) == 0x43 ? 4 : 2;
+	}
+	if (op == 0xdd || op == 0xfd) {
+		if (op2 == 0xcb)
+			return 4;
+		if (!idx[op2].first)
+			return 0;
+		if (op2 == 0xe9)		/* JP (IX) */
+			*next = 0;
+		return 1 + oplen(op2) + usesdisp(op2);
+	}
+	if (op == 0x10 || op == 0x18 || (x == 0 && z == 0 && op >= 0x20))
+		*target = (a + 2 + (signed char) op2) & 0xffff;
+	else if (op == 0xc3 || op == 0xcd || (x == 3 && (z == 2 || z == 4)))
+		*target = op2 | (rom[(a + 2) % ROMSIZE] << 8);
+	else if (x == 3 && z == 7)
+		*target = op & 0x38;
+	/* RST 8 reports an error and RST 28H enters the calculator, neither
+	   comes back to the next byte */
+	if (op == 0x18 || op == 0xc3 || op == 0xc9 || op == 0xe9 ||
+	    op == 0x76 || op == 0xcf || op == 0xef)
+		*next = 0;
+	return oplen(op);
+}
+
+/* follows the code from the restarts and the NMI */
+static void
+walk(void)
+{
+	static int stack[ROMSIZE + 16];
+	int sp = 0, a, target, next, len;
+
+	for (a = 0; a <= 0x38; a += 8)
+		stack[sp++] = a;
+	stack[sp++] = 0x66;
+	while (sp) {
+		a = stack[--sp];
+		while (a < ROMSIZE && !translated[a]) {
+			len = decode(a, &target, &next);
+			if (len == 0 || a + len > ROMSIZE)
+				break;
+			translated[a] = 1;
+			length[a] = len;
+			if (target >= 0 && target < ROMSIZE && !translated[target])
+				stack[sp++] = target;
+			if (!next)
+				break;
+			a += len;
+		}
+	}
+}
+
+static int
+isident(int c)
+{
+	return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+/* replaces the whole words from in s */
+static void
+replace(char *s, const char *from, const char *to)
+{
+	char out[1024], *p = s, *o = out;
+	size_t n = strlen(from), m = strlen(to);
+
+	while (*p) {
+		if (strncmp(p, from, n) == 0 && (p == s || !isident(p[-1]) ||
+		    !isident(*from)) && (!isident(p[n]) || !isident(from[n - 1]))) {
+			memcpy(o, to, m);
+			o += m;
+			p += n;
+		}
+		else
+			*o++ = *p++;
+	}
+	*o = 0;
+	strcpy(s, out);
+}
+
+#define WRITES	1	/* the code can write to memory */
+#define ENDS	2	/* the code can end without jumping */
+
+/* writes the code of an opcode for the instruction at a, without the
+   line containing skip nor the jumps to the handler tables of THREADED;
+   the cases in the ED and DD/FD switches end in break instead of NEXT;
+   returns the WRITES and ENDS flags */
+static int
+emit(int a, const body_struct *body, const char *skip, int inner)
+{
+	char labels[8][64], s[1024], name[128];
+	int nlabels = 0, flags = 0, threaded = 0, i, j;
+
+	for (i = body->first; i <= body->last; i++) {
+		const char *p = line[i] + strspn(line[i], "\t ");
+		size_t n = 0;
+
+		while (isident(p[n]))
+			n++;
+		if (n && p[n] == ':' && strncmp(p, "case", 4) && strncmp(p, "default", 7)) {
+			if (nlabels == 8)
+				fail("too many labels in a case");
+			sprintf(labels[nlabels++], "%.*s", (int) (n < 60 ? n : 60), p);
+		}
+	}
+	for (i = body->first; i <= body->last; i++) {
+		if (strcmp(line[i], "#ifdef THREADED") == 0)
+			threaded = 1;
+		if (threaded) {
+			threaded = strcmp(line[i], "#endif") != 0;
+			continue;
+		}
+		if (skip != NULL && strstr(line[i], skip) != NULL)
+			continue;
+		strcpy(s, line[i]);
+		replace(s, "GetBYTE_pp(PC)", "AOT_BYTE_pp(PC)");
+		replace(s, "GetBYTE(PC)", "AOT_BYTE(PC)");
+		replace(s, "GetWORD(PC)", "AOT_WORD(PC)");
+		replace(s, "JPC", "AOT_JPC");
+		replace(s, "CALLC", "AOT_CALLC");
+		sprintf(name, "goto e_%04x;", a);
+		if (inner && strcmp(s, "\t\t\tbreak;") == 0)
+			sprintf(s, "\t\t\t%s", name);
+		replace(s, "NEXT;", name);
+		for (j = 0; j < nlabels; j++) {
+			snprintf(name, sizeof(name), "%.60s_%04x", labels[j], a);
+			replace(s, labels[j], name);
+		}
+		if (strstr(s, "Put") || strstr(s, "PUSH") || strstr(s, "CALLC"))
+			flags |= WRITES;
+		if (strstr(s, "goto e_"))
+			flags |= ENDS;
+		printf("%s\n", s);
+	}
+	return flags;
+}
+
+static void
+translate(void)
+{
+	int a, i, flags;
+	body_struct cb;
+
+	for (a = 0; a < ROMSIZE; a++) {
+		int op, op2, next = a + length[a];
+
+		if (!translated[a])
+			continue;
+		op = rom[a];
+		op2 = rom[(a + 1) % ROMSIZE];
+		printf("\tcase 0x%04x:\t\t/*", a);
+		for (i = 0; i < length[a]; i++)
+			printf(" %02x", rom[a + i]);
+		printf(" */\n");
+		printf("\t\tAOT_STEP(0x%04x);\n", a);
+		printf("\t\tPC = 0x%04x;\n", a + 1);
+		if (op == 0xcb) {
+			flags = emit(a, &top[0xcb], "cbprefix:", 0);
+		}
+		else if (op == 0xed) {
+			printf("\t\top = AOT_BYTE_pp(PC);\n");
+			flags = emit(a, &ed[op2], NULL, 1);
+		}
+		else if ((op == 0xdd || op == 0xfd) && op2 == 0xcb) {
+			printf("\t\tPC++;\n");
+			printf("\t\tadr = %s + (signed char) AOT_BYTE_pp(PC);\n", op == 0xdd ? "IX" : "IY");
+			cb = top[0xcb];
+			if (strstr(line[cb.first], "adr = HL;") == NULL)
+				fail("unexpected CB prefix code");
+			cb.first++;
+			flags = emit(a, &cb, "cbprefix:", 0);
+		}
+		else if (op == 0xdd || op == 0xfd) {
+			printf("\t\tPC++;\n");
+			printf("\t\tXY = %s;\n", op == 0xdd ? "IX" : "IY");
+			flags = emit(a, &idx[op2], NULL, 1);
+		}
+		else {
+			flags = emit(a, &top[op], NULL, 0);
+		}
+		/* the code of the opcode ends at e_ unless it always jumps */
+		if (!(flags & ENDS))
+			continue;
+		printf("\te_%04x:\n", a);
+		if ((op == 0xdd || op == 0xfd) && op2 != 0xcb)
+			printf("\t\t%s = XY;\n", op == 0xdd ? "IX" : "IY");
+		if (flags & WRITES)
+			printf("\t\tAOT_HOOK();\n");
+		/* fall through to the next instruction if it follows */
+		for (i = a + 1; i < ROMSIZE && !translated[i]; i++)
+			;
+		if (i != next)
+			printf("\t\tgoto next;\n");
+	}
+}
+
+static void
+tables(void)
+{
+	int a, first = -1;
+
+	printf("static const BYTE aotimage[%d] = {", ROMSIZE);
+	for (a = 0; a < ROMSIZE; a++)
+		printf("%s0x%02x,", a % 16 ? "" : "\n\t", rom[a]);
+	printf("\n};\n\n");
+	printf("static const BYTE aotinsns[%d] = {", ROMSIZE / 8);
+	for (a = 0; a < ROMSIZE; a += 8) {
+		int bits = 0, i;
+
+		for (i = 0; i < 8; i++)
+			bits |= translated[a + i] << i;
+		printf("%s0x%02x,", a % 128 ? "" : "\n\t", bits);
+	}
+	printf("\n};\n\n");
+	/* a run ends where the code does not fall through */
+	printf("static const WORD aotruns[][2] = {\n");
+	for (a = 0; a < ROMSIZE; a++) {
+		int i;
+
+		if (!translated[a])
+			continue;
+		if (first < 0)
+			first = a;
+		for (i = a + 1; i < ROMSIZE && !translated[i]; i++)
+			;
+		if (i != a + length[a]) {
+			printf("\t{ 0x%04x, 0x%04x },\n", first, a + length[a] - 1);
+			first = -1;
+		}
+	}
+	printf("};\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc != 2)
+		fail("usage: mkromaot simz80.c > romaot.h");
+	readsource(argv[1]);
+	parse();
+	walk();
+	printf("/* generated by mkromaot from simz80.c and zx81rom.h, do not edit */\n\n");
+	printf("#ifdef AOT_TABLES\n\n");
+	tables();
+	printf("\n#else\n\n");
+	translate();
+	printf("\n#endif\n");
+	return 0;
+}
@@ -27,42 +27,335 @@ char *perl_params =
     "dfd_inline=1,"
     "ed_inline=1";
 
+#include <stdlib.h>
+#include <string.h>
 #include "mem_mmu.h"
 #include "simz80.h"
+#include "flagtab.h"	/* generated by mkflagtab */
 
-static const unsigned char partab[256] = {
-	4,0,0,4,0,4,4,0,0,4,4,0,4,0,0,4,
-	0,4,4,0,4,0,0,4,4,0,0,4,0,4,4,0,
-	0,4,4,0,4,0,0,4,4,0,0,4,0,4,4,0,
-	4,0,0,4,0,4,4,0,0,4,4,0,4,0,0,4,
-	0,4,4,0,4,0,0,4,4,0,0,4,0,4,4,0,
-	4,0,0,4,0,4,4,0,0,4,4,0,4,0,0,4,
-	4,0,0,4,0,4,4,0,0,4,4,0,4,0,0,4,
-	0,4,4,0,4,0,0,4,4,0,0,4,0,4,4,0,
-	0,4,4,0,4,0,0,4,4,0,0,4,0,4,4,0,
-	4,0,0,4,0,4,4,0,0,4,4,0,4,0,0,4,
-	4,0,0,4,0,4,4,0,0,4,4,0,4,0,0,4,
-	0,4,4,0,4,0,0,4,4,0,0,4,0,4,4,0,
-	4,0,0,4,0,4,4,0,0,4,4,0,4,0,0,4,
-	0,4,4,0,4,0,0,4,4,0,0,4,0,4,4,0,
-	0,4,4,0,4,0,0,4,4,0,0,4,0,4,4,0,
-	4,0,0,4,0,4,4,0,0,4,4,0,4,0,0,4,
+#ifdef DEBUG
+volatile int stopsim;
+#define CHECK_STOPSIM()	if (stopsim) { reason = STOP_HOOK; goto stop; }
+#else
+#define CHECK_STOPSIM()
+#endif
+
+/* With PROFILE, simz80_run() adds up in the machine the T-states of the
+   instructions it runs and, if the machine has a profile, counts each
+   opcode in the table of its prefix group, the instructions and T-states
+   at each address and the calls and restarts to it; the T-states of an
+   instruction go to its address when the next one starts. The block
+   cache and the translated ROM are then left out, so every instruction
+   goes through the dispatch. The tables have the T-states of each
+   opcode, including the prefixes and the taken branches and repeats when
+   they cost the same; the handlers add the rest with TAKEN() and
+   TSTATES(). */
+#ifdef PROFILE
+#define PROFILE_OP(g, t, op) do {					\
+	tstates += t[op];						\
+	if (profile != NULL)						\
+	    profile->count[g][op]++;					\
+} while (0)
+#define PROFILE_INSN() do {						\
+	if (profile != NULL) {						\
+	    profile->pctstates[ppc] += tstates - ptstates;		\
+	    ppc = PC & 0xffff;						\
+	    ptstates = tstates;						\
+	    profile->pccount[ppc]++;					\
+	}								\
+	PROFILE_OP(OPS_MAIN, tmain, RAM(PC));				\
+} while (0)
+#define PROFILE_CALL()							\
+	if (profile != NULL) profile->calls[PC & 0xffff]++
+#define TAKEN(cond, n)	if (cond) tstates += (n)
+#define TSTATES(n)	(tstates += (n))
+
+/* unprefixed opcodes, without a branch taken; 0 for the prefixes */
+static const BYTE tmain[256] = {
+	 4, 10,  7,  6,  4,  4,  7,  4,  4, 11,  7,  6,  4,  4,  7,  4,	/* 00 */
+	 8, 10,  7,  6,  4,  4,  7,  4, 12, 11,  7,  6,  4,  4,  7,  4,	/* 10 */
+	 7, 10, 16,  6,  4,  4,  7,  4,  7, 11, 16,  6,  4,  4,  7,  4,	/* 20 */
+	 7, 10, 13,  6, 11, 11, 10,  4,  7, 11, 13,  6,  4,  4,  7,  4,	/* 30 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* 40 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* 50 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* 60 */
+	 7,  7,  7,  7,  7,  7,  4,  7,  4,  4,  4,  4,  4,  4,  7,  4,	/* 70 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* 80 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* 90 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* A0 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* B0 */
+	 5, 10, 10, 10, 10, 11,  7, 11,  5, 10, 10,  0, 10, 17,  7, 11,	/* C0 */
+	 5, 10, 10, 11, 10, 11,  7, 11,  5,  4, 10, 11, 10,  0,  7, 11,	/* D0 */
+	 5, 10, 10, 19, 10, 11,  7, 11,  5,  4, 10,  4, 10,  0,  7, 11,	/* E0 */
+	 5, 10, 10,  4, 10, 11,  7, 11,  5,  6, 10,  4, 10,  0,  7, 11,	/* F0 */
 };
 
-#define parity(x)	partab[(x)&0xff]
+/* CB prefix */
+static const BYTE tcb[256] = {
+	 8,  8,  8,  8,  8,  8, 15,  8,  8,  8,  8,  8,  8,  8, 15,  8,	/* 00 */
+	 8,  8,  8,  8,  8,  8, 15,  8,  8,  8,  8,  8,  8,  8, 15,  8,	/* 10 */
+	 8,  8,  8,  8,  8,  8, 15,  8,  8,  8,  8,  8,  8,  8, 15,  8,	/* 20 */
+	 8,  8,  8,  8,  8,  8, 15,  8,  8,  8,  8,  8,  8,  8, 15,  8,	/* 30 */
+	 8,  8,  8,  8,  8,  8, 12,  8,  8,  8,  8,  8,  8,  8, 12,  8,	/* 40 */
+	 8,  8,  8,  8,  8,  8, 12,  8,  8,  8,  8,  8,  8,  8, 12,  8,	/* 50 */
+	 8,  8,  8,  8,  8,  8, 12,  8,  8,  8,  8,  8,  8,  8, 12,  8,	/* 60 */
+	 8,  8,  8,  8,  8,  8, 12,  8,  8,  8,  8,  8,  8,  8, 12,  8,	/* 70 */
+	 8,  8,  8,  8,  8,  8, 15,  8,  8,  8,  8,  8,  8,  8, 15,  8,	/* 80 */
+	 8,  8,  8,  8,  8,  8, 15,  8,  8,  8,  8,  8,  8,  8, 15,  8,	/* 90 */
+	 8,  8,  8,  8,  8,  8, 15,  8,  8,  8,  8,  8,  8,  8, 15,  8,	/* A0 */
+	 8,  8,  8,  8,  8,  8, 15,  8,  8,  8,  8,  8,  8,  8, 15,  8,	/* B0 */
+	 8,  8,  8,  8,  8,  8, 15,  8,  8,  8,  8,  8,  8,  8, 15,  8,	/* C0 */
+	 8,  8,  8,  8,  8,  8, 15,  8,  8,  8,  8,  8,  8,  8, 15,  8,	/* D0 */
+	 8,  8,  8,  8,  8,  8, 15,  8,  8,  8,  8,  8,  8,  8, 15,  8,	/* E0 */
+	 8,  8,  8,  8,  8,  8, 15,  8,  8,  8,  8,  8,  8,  8, 15,  8,	/* F0 */
+};
 
-#ifdef DEBUG
-volatile int stopsim;
+/* ED prefix; the undefined ones in 40..7F only take the prefix, as
+   simz80_run() runs the opcode after it on its own */
+static const BYTE ted[256] = {
+	 8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,	/* 00 */
+	 8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,	/* 10 */
+	 8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,	/* 20 */
+	 8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,	/* 30 */
+	12, 12, 15, 20,  8, 14,  8,  9, 12, 12, 15, 20,  4, 14,  4,  9,	/* 40 */
+	12, 12, 15, 20,  4,  4,  8,  9, 12, 12, 15, 20,  4,  4,  8,  9,	/* 50 */
+	12, 12, 15, 20,  4,  4,  4, 18, 12, 12, 15, 20,  4,  4,  4, 18,	/* 60 */
+	12, 12, 15, 20,  4,  4,  4,  4, 12, 12, 15, 20,  4,  4,  4,  4,	/* 70 */
+	 8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,	/* 80 */
+	 8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,	/* 90 */
+	16, 16, 16, 16,  8,  8,  8,  8, 16, 16, 16, 16,  8,  8,  8,  8,	/* A0 */
+	16, 16, 16, 16,  8,  8,  8,  8, 16, 16, 16, 16,  8,  8,  8,  8,	/* B0 */
+	 8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,	/* C0 */
+	 8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,	/* D0 */
+	 8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,	/* E0 */
+	 8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,	/* F0 */
+};
+
+/* DD and FD prefixes; the undefined ones only take the prefix, and
+   DDCB/FDCB are all in tindexedcb */
+static const BYTE tindexed[256] = {
+	 4,  4,  4,  4,  4,  4,  4,  4,  4, 15,  4,  4,  4,  4,  4,  4,	/* 00 */
+	 4,  4,  4,  4,  4,  4,  4,  4,  4, 15,  4,  4,  4,  4,  4,  4,	/* 10 */
+	 4, 14, 20, 10,  8,  8, 11,  4,  4, 15, 20, 10,  8,  8, 11,  4,	/* 20 */
+	 4,  4,  4,  4, 23, 23, 19,  4,  4, 15,  4,  4,  4,  4,  4,  4,	/* 30 */
+	 4,  4,  4,  4,  8,  8, 19,  4,  4,  4,  4,  4,  8,  8, 19,  4,	/* 40 */
+	 4,  4,  4,  4,  8,  8, 19,  4,  4,  4,  4,  4,  8,  8, 19,  4,	/* 50 */
+	 8,  8,  8,  8,  8,  8, 19,  8,  8,  8,  8,  8,  8,  8, 19,  8,	/* 60 */
+	19, 19, 19, 19, 19, 19,  4, 19,  4,  4,  4,  4,  8,  8, 19,  4,	/* 70 */
+	 4,  4,  4,  4,  8,  8, 19,  4,  4,  4,  4,  4,  8,  8, 19,  4,	/* 80 */
+	 4,  4,  4,  4,  8,  8, 19,  4,  4,  4,  4,  4,  8,  8, 19,  4,	/* 90 */
+	 4,  4,  4,  4,  8,  8, 19,  4,  4,  4,  4,  4,  8,  8, 19,  4,	/* A0 */
+	 4,  4,  4,  4,  8,  8, 19,  4,  4,  4,  4,  4,  8,  8, 19,  4,	/* B0 */
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  0,  4,  4,  4,  4,	/* C0 */
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,	/* D0 */
+	 4, 14,  4, 23,  4, 15,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,	/* E0 */
+	 4,  4,  4,  4,  4,  4,  4,  4,  4, 10,  4,  4,  4,  4,  4,  4,	/* F0 */
+};
+
+/* DDCB and FDCB, with the prefix and the displacement */
+static const BYTE tindexedcb[256] = {
+	23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,	/* 00 */
+	23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,	/* 10 */
+	23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,	/* 20 */
+	23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,	/* 30 */
+	20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20,	/* 40 */
+	20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20,	/* 50 */
+	20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20,	/* 60 */
+	20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20,	/* 70 */
+	23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,	/* 80 */
+	23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,	/* 90 */
+	23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,	/* A0 */
+	23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,	/* B0 */
+	23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,	/* C0 */
+	23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,	/* D0 */
+	23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,	/* E0 */
+	23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,	/* F0 */
+};
+#else
+#define PROFILE_OP(g, t, op)
+#define PROFILE_INSN()
+#define PROFILE_CALL()
+#define TAKEN(cond, n)
+#define TSTATES(n)
+#endif
+
+/* checks made before each instruction */
+#define CHECK() do {							\
+	CHECK_STOPSIM();						\
+	if (stops != NULL && TSTSTOP(stops, PC)) {			\
+	    reason = STOP_PC;						\
+	    goto stop;							\
+	}								\
+	if (budget-- == 0) {						\
+	    reason = STOP_BUDGET;					\
+	    goto stop;							\
+	}								\
+} while (0)
+
+/* With THREADED the instructions are labels in a table of addresses (a
+   GCC extension) and each one ends jumping straight to the next, instead
+   of going back to the top of the switch. */
+/* With ROMAOT the ROM translated to C by mkromaot runs instead of the
+   interpreter wherever it has not been patched, as set by simz80_aot(),
+   as long as there is no stop set to check after every instruction. */
+#if defined(ROMAOT) && !defined(DEBUG) && !defined(PROFILE)
+#define AOT_TABLES
+#include "romaot.h"	/* generated by mkromaot */
+#undef AOT_TABLES
+
+#define ENTER_AOT()							\
+	if (aot && PC < AOTTOP && TSTSTOP(m->aotmap, PC))		\
+	    goto translated
+
+/* the operands of translated instructions are constants in the image */
+#define AOT_BYTE(a)	aotimage[(a)&(AOTTOP-1)]
+#define AOT_BYTE_pp(a)	aotimage[(a++)&(AOTTOP-1)]
+#define AOT_WORD(a)	(AOT_BYTE(a) | (AOT_BYTE((a)+1) << 8))
+#define AOT_JPC(cond)	PC = cond ? AOT_WORD(PC) : PC+2
+
+#define AOT_CALLC(cond) {						\
+    if (cond) {								\
+	FASTREG adrr = AOT_WORD(PC);					\
+	PUSH(PC+2);							\
+	PC = adrr;							\
+    }									\
+    else								\
+	PC += 2;							\
+}
+
+/* before and after each translated instruction, as CHECK() and NEXT */
+#define AOT_STEP(a)							\
+	if (budget-- == 0) {						\
+	    PC = a;							\
+	    reason = STOP_BUDGET;					\
+	    goto stop;							\
+	}
+
+#define AOT_HOOK()							\
+	if (memhook) {							\
+	    reason = STOP_HOOK;						\
+	    goto stop;							\
+	}								\
+	if (!TSTSTOP(m->aotmap, PC))	/* the code wrote over itself */ \
+	    goto next
+#else
+#define ENTER_AOT()
+#endif
+
+/* With THREADED and no stop set, the code reached by a branch is recorded
+   in the block cache enabled by simz80_blocks(), the handler of each
+   instruction as it is about to run. When the same address is reached
+   again its block runs from handler to handler while bn counts the ones
+   left, with the budget taken for the whole block at once. */
+#if defined(THREADED) && !defined(DEBUG) && !defined(PROFILE)
+#define BLOCKCACHE
+#define BLOCK_NEXT()							\
+	if (bn) {							\
+	    bn--;							\
+	    PC++;							\
+	    goto **bp++;						\
+	}
+#define RECORD()	if (blk) goto record
+#else
+#define BLOCK_NEXT()
+#define RECORD()
+#endif
+
+#ifdef THREADED
+#define CASE(n)	op_##n
+#define NEXT do {							\
+	if (memhook) {							\
+	    reason = STOP_HOOK;						\
+	    goto stop;							\
+	}								\
+	BLOCK_NEXT();							\
+	ENTER_AOT();							\
+	CHECK();							\
+	RECORD();							\
+	PROFILE_INSN();							\
+	goto *optab[RAM_pp(PC)];					\
+} while (0)
+#else
+#define CASE(n)	case n
+#define NEXT	break
+#endif
+
+/* With THREADED the cases of the ED and DD/FD switches are labels too,
+   jumped to from edtab and xytab without going through the switch. */
+#ifdef THREADED
+#define EDCASE(n)	case n: ed_##n
+#define XYCASE(n)	case n: xy_##n
+#define DEFAULT(t)	default: t##_default
+#else
+#define EDCASE(n)	case n
+#define XYCASE(n)	case n
+#define DEFAULT(t)	default
 #endif
 
+/* With THREADED each CB opcode has its own handler in cbtab, the code
+   after cbprefix with the operand and the operation known: a row of the
+   table is an operation on the eight operands, adr being (HL) or (XY+dd) */
+#define CBGET0		hreg(BC)
+#define CBGET1		lreg(BC)
+#define CBGET2		hreg(DE)
+#define CBGET3		lreg(DE)
+#define CBGET4		hreg(HL)
+#define CBGET5		lreg(HL)
+#define CBGET6		GetBYTE(adr)
+#define CBGET7		hreg(AF)
+#define CBPUT0(v)	Sethreg(BC, v)
+#define CBPUT1(v)	Setlreg(BC, v)
+#define CBPUT2(v)	Sethreg(DE, v)
+#define CBPUT3(v)	Setlreg(DE, v)
+#define CBPUT4(v)	Sethreg(HL, v)
+#define CBPUT5(v)	Setlreg(HL, v)
+#define CBPUT6(v)	PutBYTE(adr, v)
+#define CBPUT7(v)	Sethreg(AF, v)
+
+/* the shift or rotate, RES or SET, code giving temp from acu */
+#define CBOP(name, z, code)						\
+	name##_##z:							\
+		acu = CBGET##z;						\
+		code;							\
+		CBPUT##z(temp);						\
+		NEXT
+
+#define CBROW(name, code)						\
+	CBOP(name, 0, code); CBOP(name, 1, code); CBOP(name, 2, code);	\
+	CBOP(name, 3, code); CBOP(name, 4, code); CBOP(name, 5, code);	\
+	CBOP(name, 6, code); CBOP(name, 7, code)
+
+#define CBSHIFT(code)	code; AF = (AF & ~0xff) | szptab[temp & 0xff] | !!cbits
+
+/* BIT b, which writes its operand back like the switch does */
+#define CBBIT(b, z)							\
+	cb_bit##b##_##z:						\
+		acu = CBGET##z;						\
+		if (acu & (1 << b))					\
+			AF = (AF & ~0xfe) | 0x10 | ((b == 7) << 7);	\
+		else							\
+			AF = (AF & ~0xfe) | 0x54;			\
+		if (z != 6)						\
+			AF |= (acu & 0x28);				\
+		CBPUT##z(acu);						\
+		NEXT
+
+#define CBBITROW(b)							\
+	CBBIT(b, 0); CBBIT(b, 1); CBBIT(b, 2); CBBIT(b, 3);		\
+	CBBIT(b, 4); CBBIT(b, 5); CBBIT(b, 6); CBBIT(b, 7)
+
+#define CBTABROW(name)							\
+	&&name##_0, &&name##_1, &&name##_2, &&name##_3,			\
+	&&name##_4, &&name##_5, &&name##_6, &&name##_7
+
 #define POP(x)	do {							\
 	FASTREG y = RAM_pp(SP);						\
 	x = y + (RAM_pp(SP) << 8);					\
 } while (0)
 
 #define PUSH(x) do {							\
-	mm_RAM(SP) = (x) >> 8;						\
-	mm_RAM(SP) = x;							\
+	--SP; PutBYTE(SP, (x) >> 8);					\
+	--SP; PutBYTE(SP, x);						\
 } while (0)
 
 #define JPC(cond) PC = cond ? GetWORD(PC) : PC+2
@@ -72,6 +365,8 @@ volatile int stopsim;
 	FASTREG adrr = GetWORD(PC);					\
 	PUSH(PC+2);							\
 	PC = adrr;							\
+	TSTATES(7);							\
+	PROFILE_CALL();							\
     }									\
     else								\
 	PC += 2;							\
@@ -79,97 +374,395 @@ volatile int stopsim;
 
 /* load Z80 registers into (we hope) host registers */
 #define LOAD_STATE()							\
-    PC = pc;								\
-    AF = af[af_sel];							\
-    BC = regs[regs_sel].bc;						\
-    DE = regs[regs_sel].de;						\
-    HL = regs[regs_sel].hl;						\
-    IX = ix;								\
-    IY = iy;								\
-    SP = sp
+    PC = m->pc;								\
+    AF = m->af[m->af_sel];							\
+    BC = m->regs[m->regs_sel].bc;						\
+    DE = m->regs[m->regs_sel].de;						\
+    HL = m->regs[m->regs_sel].hl;						\
+    IX = m->ix;								\
+    IY = m->iy;								\
+    SP = m->sp
 
 /* load Z80 registers into (we hope) host registers */
 #define DECLARE_STATE()							\
-    FASTREG PC = pc;							\
-    FASTREG AF = af[af_sel];						\
-    FASTREG BC = regs[regs_sel].bc;					\
-    FASTREG DE = regs[regs_sel].de;					\
-    FASTREG HL = regs[regs_sel].hl;					\
-    FASTREG IX = ix;							\
-    FASTREG IY = iy;							\
-    FASTREG SP = sp
+    FASTREG PC = m->pc;							\
+    FASTREG AF = m->af[m->af_sel];						\
+    FASTREG BC = m->regs[m->regs_sel].bc;					\
+    FASTREG DE = m->regs[m->regs_sel].de;					\
+    FASTREG HL = m->regs[m->regs_sel].hl;					\
+    FASTREG IX = m->ix;							\
+    FASTREG IY = m->iy;							\
+    FASTREG SP = m->sp
 
 /* save Z80 registers back into memory */
 #define SAVE_STATE()							\
-    pc = PC;								\
-    af[af_sel] = AF;							\
-    regs[regs_sel].bc = BC;						\
-    regs[regs_sel].de = DE;						\
-    regs[regs_sel].hl = HL;						\
-    ix = IX;								\
-    iy = IY;								\
-    sp = SP
+    m->pc = PC;								\
+    m->af[m->af_sel] = AF;							\
+    m->regs[m->regs_sel].bc = BC;						\
+    m->regs[m->regs_sel].de = DE;						\
+    m->regs[m->regs_sel].hl = HL;						\
+    m->ix = IX;								\
+    m->iy = IY;								\
+    m->sp = SP
+
+#ifdef BLOCKCACHE
+/* counts the blocks in the watch pages of first..last-1 by delta, the
+   pages with blocks are watched by blockwritten() */
+static void
+blockpages(machine_struct *m, unsigned int first, unsigned int last, int delta)
+{
+    unsigned int p;
+
+    for (p = first >> WATCHSHIFT; p <= (last - 1) >> WATCHSHIFT; p++) {
+	unsigned short *c = &m->blocks->codepage[p % WATCHPAGES];
+
+	if (delta > 0 && (*c)++ == 0)
+	    m->watchpage[p % WATCHPAGES]++;
+	else if (delta < 0 && --(*c) == 0)
+	    m->watchpage[p % WATCHPAGES]--;
+    }
+}
+
+/* the block may use the bytes up to end */
+static void
+blockgrow(machine_struct *m, block_struct *b, unsigned int end)
+{
+    unsigned int first = b->end == b->start ? b->start :
+	(((b->end - 1) >> WATCHSHIFT) + 1) << WATCHSHIFT;
+
+    if (first < end)
+	blockpages(m, first, end, 1);
+    b->end = end;
+}
+
+static void
+blockfree(machine_struct *m, block_struct *b)
+{
+    if (b->live && b->end != b->start)
+	blockpages(m, b->start, b->end, -1);
+    b->live = 0;
+    b->n = 0;
+}
 
+/* a write drops the blocks it falls in; one that is running leaves
+   through blockexit at its next instruction */
+static int
+blockwritten(machine_struct *m, WORD addr, BYTE value)
+{
+    blockcache_struct *c = m->blocks;
+    int i, j;
+
+    if (c == NULL || c->codepage[addr >> WATCHSHIFT] == 0)
+	return 0;
+    for (i = 0; i < BLOCKS; i++) {
+	block_struct *b = &c->block[i];
+
+	if (b->live && ((addr - b->start) & 0xffff) < b->end - b->start) {
+	    blockfree(m, b);
+	    for (j = 0; j < BLOCKOPS; j++)
+		b->op[j] = c->exit;
+	}
+    }
+    return 0;
+}
+
+/* the slot of blockwritten() in the watches, -1 if it is not there */
+static int
+blockwatched(machine_struct *m)
+{
+    int i;
+
+    for (i = 0; i < m->nwatches; i++)
+	if (m->watches[i].hook == blockwritten)
+	    return i;
+    return -1;
+}
+
+/* empties the block cache; without its watch clearwatches() has already
+   dropped the pages it counted */
+static void
+blockflush(machine_struct *m)
+{
+    int i, watched = blockwatched(m) >= 0;
+
+    for (i = 0; i < BLOCKS; i++) {
+	if (watched)
+	    blockfree(m, &m->blocks->block[i]);
+	m->blocks->block[i].live = 0;
+	m->blocks->block[i].n = 0;
+    }
+    memclr(m->blocks->codepage, sizeof(m->blocks->codepage));
+}
+
+/* the block cache of m with its watch in place, NULL if there is no
+   cache or no watch left for it */
+static blockcache_struct *
+blockwatch(machine_struct *m)
+{
+#ifndef MMU
+    /* where the RAM repeats, a write changes the code at other addresses */
+    if (m->ramstart + m->ramsize < Z80MEMSIZE*1024)
+	return NULL;
+#endif
+    if (m->blocks == NULL || blockwatched(m) >= 0)
+	return m->blocks;
+    if (m->nwatches == MAXWATCHES)
+	return NULL;
+    blockflush(m);
+    /* the watch covers the whole memory but only counts its pages as the
+       blocks take them */
+    m->watches[m->nwatches].first = 0;
+    m->watches[m->nwatches].last = 0xffff;
+    m->watches[m->nwatches].hook = blockwritten;
+    m->nwatches++;
+    return m->blocks;
+}
+#endif
+
+/* execute one instruction, kept for callers that single step */
 FASTWORK
-simz80(FASTREG PC)
+simz80(machine_struct *m)
 {
-    FASTREG AF = af[af_sel];
-    FASTREG BC = regs[regs_sel].bc;
-    FASTREG DE = regs[regs_sel].de;
-    FASTREG HL = regs[regs_sel].hl;
-    FASTREG SP = sp;
-    FASTREG IX = ix;
-    FASTREG IY = iy;
+    if (simz80_run(m, NULL, 1) == STOP_HALT)
+	return m->pc;
+    return m->pc|0x10000;	/* flag non-bios stop */
+}
+
+/* run instructions until PC is in the stop set, budget instructions have
+   been executed, a write watch or a breakpoint asks to stop or a HALT is
+   found; registers stay in host variables for the whole run */
+int
+simz80_run(machine_struct *m, const BYTE *stops, unsigned long budget)
+{
+#ifndef MMU
+    BYTE *const *const rpage = m->rpage;
+    BYTE *const *const wpage = m->wpage;
+#endif
+    const BYTE *const watchpage = m->watchpage;
+    BYTE *const dirtypage = m->dirtypage;
+    int memhook = 0;
+    FASTREG PC = m->pc;
+    FASTREG AF = m->af[m->af_sel];
+    FASTREG BC = m->regs[m->regs_sel].bc;
+    FASTREG DE = m->regs[m->regs_sel].de;
+    FASTREG HL = m->regs[m->regs_sel].hl;
+    FASTREG SP = m->sp;
+    FASTREG IX = m->ix;
+    FASTREG IY = m->iy;
+    FASTREG XY = 0;		/* IX or IY while in a DD or FD prefix */
     FASTWORK temp, acu, sum, cbits;
-    FASTWORK op, adr;
+    FASTWORK op = 0, adr = 0;
+    const unsigned long start = budget;
+#ifdef PROFILE
+    unsigned long long tstates = m->tstates;
+    profile_struct *const profile = m->profile;
+    unsigned long long ptstates = tstates;	/* when ppc started */
+    FASTREG ppc = PC & 0xffff;	/* the instruction running */
+#endif
+#if defined(ROMAOT) && !defined(DEBUG) && !defined(PROFILE)
+    const int aot = stops == NULL;
+#endif
+#ifdef BLOCKCACHE
+    blockcache_struct *const blocks = stops == NULL ? blockwatch(m) : NULL;
+    block_struct *blk = NULL;	/* the block being recorded */
+    void **bp = NULL;		/* the next handler of the block running */
+    unsigned long bn = 0;	/* and the number of them left */
+#endif
+    int reason;
+#ifdef THREADED
+    static void *const optab[256] = {
+	&&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03,
+	&&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07,
+	&&op_0x08, &&op_0x09, &&op_0x0A, &&op_0x0B,
+	&&op_0x0C, &&op_0x0D, &&op_0x0E, &&op_0x0F,
+	&&op_0x10, &&op_0x11, &&op_0x12, &&op_0x13,
+	&&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17,
+	&&op_0x18, &&op_0x19, &&op_0x1A, &&op_0x1B,
+	&&op_0x1C, &&op_0x1D, &&op_0x1E, &&op_0x1F,
+	&&op_0x20, &&op_0x21, &&op_0x22, &&op_0x23,
+	&&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27,
+	&&op_0x28, &&op_0x29, &&op_0x2A, &&op_0x2B,
+	&&op_0x2C, &&op_0x2D, &&op_0x2E, &&op_0x2F,
+	&&op_0x30, &&op_0x31, &&op_0x32, &&op_0x33,
+	&&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37,
+	&&op_0x38, &&op_0x39, &&op_0x3A, &&op_0x3B,
+	&&op_0x3C, &&op_0x3D, &&op_0x3E, &&op_0x3F,
+	&&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43,
+	&&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47,
+	&&op_0x48, &&op_0x49, &&op_0x4A, &&op_0x4B,
+	&&op_0x4C, &&op_0x4D, &&op_0x4E, &&op_0x4F,
+	&&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53,
+	&&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57,
+	&&op_0x58, &&op_0x59, &&op_0x5A, &&op_0x5B,
+	&&op_0x5C, &&op_0x5D, &&op_0x5E, &&op_0x5F,
+	&&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63,
+	&&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67,
+	&&op_0x68, &&op_0x69, &&op_0x6A, &&op_0x6B,
+	&&op_0x6C, &&op_0x6D, &&op_0x6E, &&op_0x6F,
+	&&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73,
+	&&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77,
+	&&op_0x78, &&op_0x79, &&op_0x7A, &&op_0x7B,
+	&&op_0x7C, &&op_0x7D, &&op_0x7E, &&op_0x7F,
+	&&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83,
+	&&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87,
+	&&op_0x88, &&op_0x89, &&op_0x8A, &&op_0x8B,
+	&&op_0x8C, &&op_0x8D, &&op_0x8E, &&op_0x8F,
+	&&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93,
+	&&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97,
+	&&op_0x98, &&op_0x99, &&op_0x9A, &&op_0x9B,
+	&&op_0x9C, &&op_0x9D, &&op_0x9E, &&op_0x9F,
+	&&op_0xA0, &&op_0xA1, &&op_0xA2, &&op_0xA3,
+	&&op_0xA4, &&op_0xA5, &&op_0xA6, &&op_0xA7,
+	&&op_0xA8, &&op_0xA9, &&op_0xAA, &&op_0xAB,
+	&&op_0xAC, &&op_0xAD, &&op_0xAE, &&op_0xAF,
+	&&op_0xB0, &&op_0xB1, &&op_0xB2, &&op_0xB3,
+	&&op_0xB4, &&op_0xB5, &&op_0xB6, &&op_0xB7,
+	&&op_0xB8, &&op_0xB9, &&op_0xBA, &&op_0xBB,
+	&&op_0xBC, &&op_0xBD, &&op_0xBE, &&op_0xBF,
+	&&op_0xC0, &&op_0xC1, &&op_0xC2, &&op_0xC3,
+	&&op_0xC4, &&op_0xC5, &&op_0xC6, &&op_0xC7,
+	&&op_0xC8, &&op_0xC9, &&op_0xCA, &&op_0xCB,
+	&&op_0xCC, &&op_0xCD, &&op_0xCE, &&op_0xCF,
+	&&op_0xD0, &&op_0xD1, &&op_0xD2, &&op_0xD3,
+	&&op_0xD4, &&op_0xD5, &&op_0xD6, &&op_0xD7,
+	&&op_0xD8, &&op_0xD9, &&op_0xDA, &&op_0xDB,
+	&&op_0xDC, &&op_0xDD, &&op_0xDE, &&op_0xDF,
+	&&op_0xE0, &&op_0xE1, &&op_0xE2, &&op_0xE3,
+	&&op_0xE4, &&op_0xE5, &&op_0xE6, &&op_0xE7,
+	&&op_0xE8, &&op_0xE9, &&op_0xEA, &&op_0xEB,
+	&&op_0xEC, &&op_0xED, &&op_0xEE, &&op_0xEF,
+	&&op_0xF0, &&op_0xF1, &&op_0xF2, &&op_0xF3,
+	&&op_0xF4, &&op_0xF5, &&op_0xF6, &&op_0xF7,
+	&&op_0xF8, &&op_0xF9, &&op_0xFA, &&op_0xFB,
+	&&op_0xFC, &&op_0xFD, &&op_0xFE, &&op_0xFF,
+    };
+    /* the handlers after a prefix: those of ED and DD/FD are the cases of
+       their switches, the CB ones are made by CBROW and CBBITROW */
+    static void *const edtab[256] = {
+	[0 ... 255] = &&ed_default,
+	[0x40] = &&ed_0x40, [0x41] = &&ed_0x41, [0x42] = &&ed_0x42,
+	[0x43] = &&ed_0x43, [0x44] = &&ed_0x44, [0x45] = &&ed_0x45,
+	[0x46] = &&ed_0x46, [0x47] = &&ed_0x47, [0x48] = &&ed_0x48,
+	[0x49] = &&ed_0x49, [0x4A] = &&ed_0x4A, [0x4B] = &&ed_0x4B,
+	[0x4D] = &&ed_0x4D, [0x4F] = &&ed_0x4F, [0x50] = &&ed_0x50,
+	[0x51] = &&ed_0x51, [0x52] = &&ed_0x52, [0x53] = &&ed_0x53,
+	[0x56] = &&ed_0x56, [0x57] = &&ed_0x57, [0x58] = &&ed_0x58,
+	[0x59] = &&ed_0x59, [0x5A] = &&ed_0x5A, [0x5B] = &&ed_0x5B,
+	[0x5E] = &&ed_0x5E, [0x5F] = &&ed_0x5F, [0x60] = &&ed_0x60,
+	[0x61] = &&ed_0x61, [0x62] = &&ed_0x62, [0x63] = &&ed_0x63,
+	[0x67] = &&ed_0x67, [0x68] = &&ed_0x68, [0x69] = &&ed_0x69,
+	[0x6A] = &&ed_0x6A, [0x6B] = &&ed_0x6B, [0x6F] = &&ed_0x6F,
+	[0x70] = &&ed_0x70, [0x71] = &&ed_0x71, [0x72] = &&ed_0x72,
+	[0x73] = &&ed_0x73, [0x78] = &&ed_0x78, [0x79] = &&ed_0x79,
+	[0x7A] = &&ed_0x7A, [0x7B] = &&ed_0x7B, [0xA0] = &&ed_0xA0,
+	[0xA1] = &&ed_0xA1, [0xA2] = &&ed_0xA2, [0xA3] = &&ed_0xA3,
+	[0xA8] = &&ed_0xA8, [0xA9] = &&ed_0xA9, [0xAA] = &&ed_0xAA,
+	[0xAB] = &&ed_0xAB, [0xB0] = &&ed_0xB0, [0xB1] = &&ed_0xB1,
+	[0xB2] = &&ed_0xB2, [0xB3] = &&ed_0xB3, [0xB8] = &&ed_0xB8,
+	[0xB9] = &&ed_0xB9, [0xBA] = &&ed_0xBA, [0xBB] = &&ed_0xBB,
+    };
+    static void *const xytab[256] = {
+	[0 ... 255] = &&xy_default,
+	[0x09] = &&xy_0x09, [0x19] = &&xy_0x19, [0x21] = &&xy_0x21,
+	[0x22] = &&xy_0x22, [0x23] = &&xy_0x23, [0x24] = &&xy_0x24,
+	[0x25] = &&xy_0x25, [0x26] = &&xy_0x26, [0x29] = &&xy_0x29,
+	[0x2A] = &&xy_0x2A, [0x2B] = &&xy_0x2B, [0x2C] = &&xy_0x2C,
+	[0x2D] = &&xy_0x2D, [0x2E] = &&xy_0x2E, [0x34] = &&xy_0x34,
+	[0x35] = &&xy_0x35, [0x36] = &&xy_0x36, [0x39] = &&xy_0x39,
+	[0x44] = &&xy_0x44, [0x45] = &&xy_0x45, [0x46] = &&xy_0x46,
+	[0x4C] = &&xy_0x4C, [0x4D] = &&xy_0x4D, [0x4E] = &&xy_0x4E,
+	[0x54] = &&xy_0x54, [0x55] = &&xy_0x55, [0x56] = &&xy_0x56,
+	[0x5C] = &&xy_0x5C, [0x5D] = &&xy_0x5D, [0x5E] = &&xy_0x5E,
+	[0x60] = &&xy_0x60, [0x61] = &&xy_0x61, [0x62] = &&xy_0x62,
+	[0x63] = &&xy_0x63, [0x64] = &&xy_0x64, [0x65] = &&xy_0x65,
+	[0x66] = &&xy_0x66, [0x67] = &&xy_0x67, [0x68] = &&xy_0x68,
+	[0x69] = &&xy_0x69, [0x6A] = &&xy_0x6A, [0x6B] = &&xy_0x6B,
+	[0x6C] = &&xy_0x6C, [0x6D] = &&xy_0x6D, [0x6E] = &&xy_0x6E,
+	[0x6F] = &&xy_0x6F, [0x70] = &&xy_0x70, [0x71] = &&xy_0x71,
+	[0x72] = &&xy_0x72, [0x73] = &&xy_0x73, [0x74] = &&xy_0x74,
+	[0x75] = &&xy_0x75, [0x77] = &&xy_0x77, [0x7C] = &&xy_0x7C,
+	[0x7D] = &&xy_0x7D, [0x7E] = &&xy_0x7E, [0x84] = &&xy_0x84,
+	[0x85] = &&xy_0x85, [0x86] = &&xy_0x86, [0x8C] = &&xy_0x8C,
+	[0x8D] = &&xy_0x8D, [0x8E] = &&xy_0x8E, [0x94] = &&xy_0x94,
+	[0x95] = &&xy_0x95, [0x96] = &&xy_0x96, [0x9C] = &&xy_0x9C,
+	[0x9D] = &&xy_0x9D, [0x9E] = &&xy_0x9E, [0xA4] = &&xy_0xA4,
+	[0xA5] = &&xy_0xA5, [0xA6] = &&xy_0xA6, [0xAC] = &&xy_0xAC,
+	[0xAD] = &&xy_0xAD, [0xAE] = &&xy_0xAE, [0xB4] = &&xy_0xB4,
+	[0xB5] = &&xy_0xB5, [0xB6] = &&xy_0xB6, [0xBC] = &&xy_0xBC,
+	[0xBD] = &&xy_0xBD, [0xBE] = &&xy_0xBE, [0xCB] = &&xy_0xCB,
+	[0xE1] = &&xy_0xE1, [0xE3] = &&xy_0xE3, [0xE5] = &&xy_0xE5,
+	[0xE9] = &&xy_0xE9, [0xF9] = &&xy_0xF9,
+    };
+    static void *const cbtab[256] = {
+	CBTABROW(cb_rlc), CBTABROW(cb_rrc),
+	CBTABROW(cb_rl), CBTABROW(cb_rr),
+	CBTABROW(cb_sla), CBTABROW(cb_sra),
+	CBTABROW(cb_slia), CBTABROW(cb_srl),
+	CBTABROW(cb_bit0), CBTABROW(cb_bit1),
+	CBTABROW(cb_bit2), CBTABROW(cb_bit3),
+	CBTABROW(cb_bit4), CBTABROW(cb_bit5),
+	CBTABROW(cb_bit6), CBTABROW(cb_bit7),
+	CBTABROW(cb_res0), CBTABROW(cb_res1),
+	CBTABROW(cb_res2), CBTABROW(cb_res3),
+	CBTABROW(cb_res4), CBTABROW(cb_res5),
+	CBTABROW(cb_res6), CBTABROW(cb_res7),
+	CBTABROW(cb_set0), CBTABROW(cb_set1),
+	CBTABROW(cb_set2), CBTABROW(cb_set3),
+	CBTABROW(cb_set4), CBTABROW(cb_set5),
+	CBTABROW(cb_set6), CBTABROW(cb_set7),
+    };
+#endif
+#ifdef BLOCKCACHE
+    if (blocks)
+	blocks->exit = &&blockexit;
+#endif
 
-#ifdef DEBUG
-    while (!stopsim) {
+next:
+    ENTER_AOT();
+    CHECK();
+    PROFILE_INSN();
+#ifdef THREADED
+    RECORD();
+    goto *optab[RAM_pp(PC)];
+    {
 #else
-    { // while (1) {
-#endif
     switch(RAM_pp(PC)) {
-	case 0x00:			/* NOP */
-		break;
-	case 0x01:			/* LD BC,nnnn */
+#endif
+	CASE(0x00):			/* NOP */
+		NEXT;
+	CASE(0x01):			/* LD BC,nnnn */
 		BC = GetWORD(PC);
 		PC += 2;
-		break;
-	case 0x02:			/* LD (BC),A */
+		NEXT;
+	CASE(0x02):			/* LD (BC),A */
 		PutBYTE(BC, hreg(AF));
-		break;
-	case 0x03:			/* INC BC */
+		NEXT;
+	CASE(0x03):			/* INC BC */
 		++BC;
-		break;
-	case 0x04:			/* INC B */
+		NEXT;
+	CASE(0x04):			/* INC B */
 		BC += 0x100;
 		temp = hreg(BC);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0) << 4) |
-			((temp == 0x80) << 2);
-		break;
-	case 0x05:			/* DEC B */
+		AF = (AF & ~0xfe) | inctab[temp & 0xff];
+		NEXT;
+	CASE(0x05):			/* DEC B */
 		BC -= 0x100;
 		temp = hreg(BC);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0xf) << 4) |
-			((temp == 0x7f) << 2) | 2;
-		break;
-	case 0x06:			/* LD B,nn */
+		AF = (AF & ~0xfe) | dectab[temp & 0xff];
+		NEXT;
+	CASE(0x06):			/* LD B,nn */
 		Sethreg(BC, GetBYTE_pp(PC));
-		break;
-	case 0x07:			/* RLCA */
+		NEXT;
+	CASE(0x07):			/* RLCA */
 		AF = ((AF >> 7) & 0x0128) | ((AF << 1) & ~0x1ff) |
 			(AF & 0xc4) | ((AF >> 15) & 1);
-		break;
-	case 0x08:			/* EX AF,AF' */
-		af[af_sel] = AF;
-		af_sel = 1 - af_sel;
-		AF = af[af_sel];
-		break;
-	case 0x09:			/* ADD HL,BC */
+		NEXT;
+	CASE(0x08):			/* EX AF,AF' */
+		m->af[m->af_sel] = AF;
+		m->af_sel = 1 - m->af_sel;
+		AF = m->af[m->af_sel];
+		NEXT;
+	CASE(0x09):			/* ADD HL,BC */
 		HL &= 0xffff;
 		BC &= 0xffff;
 		sum = HL + BC;
@@ -177,78 +770,67 @@ simz80(FASTREG PC)
 		HL = sum;
 		AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
 			(cbits & 0x10) | ((cbits >> 8) & 1);
-		break;
-	case 0x0A:			/* LD A,(BC) */
+		NEXT;
+	CASE(0x0A):			/* LD A,(BC) */
 		Sethreg(AF, GetBYTE(BC));
-		break;
-	case 0x0B:			/* DEC BC */
+		NEXT;
+	CASE(0x0B):			/* DEC BC */
 		--BC;
-		break;
-	case 0x0C:			/* INC C */
+		NEXT;
+	CASE(0x0C):			/* INC C */
 		temp = lreg(BC)+1;
 		Setlreg(BC, temp);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0) << 4) |
-			((temp == 0x80) << 2);
-		break;
-	case 0x0D:			/* DEC C */
+		AF = (AF & ~0xfe) | inctab[temp & 0xff];
+		NEXT;
+	CASE(0x0D):			/* DEC C */
 		temp = lreg(BC)-1;
 		Setlreg(BC, temp);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0xf) << 4) |
-			((temp == 0x7f) << 2) | 2;
-		break;
-	case 0x0E:			/* LD C,nn */
+		AF = (AF & ~0xfe) | dectab[temp & 0xff];
+		NEXT;
+	CASE(0x0E):			/* LD C,nn */
 		Setlreg(BC, GetBYTE_pp(PC));
-		break;
-	case 0x0F:			/* RRCA */
+		NEXT;
+	CASE(0x0F):			/* RRCA */
 		temp = hreg(AF);
 		sum = temp >> 1;
 		AF = ((temp & 1) << 15) | (sum << 8) |
 			(sum & 0x28) | (AF & 0xc4) | (temp & 1);
-		break;
-	case 0x10:			/* DJNZ dd */
+		NEXT;
+	CASE(0x10):			/* DJNZ dd */
 		PC += ((BC -= 0x100) & 0xff00) ? (signed char) GetBYTE(PC) + 1 : 1;
-		break;
-	case 0x11:			/* LD DE,nnnn */
+		TAKEN(BC & 0xff00, 5);
+		goto branched;
+	CASE(0x11):			/* LD DE,nnnn */
 		DE = GetWORD(PC);
 		PC += 2;
-		break;
-	case 0x12:			/* LD (DE),A */
+		NEXT;
+	CASE(0x12):			/* LD (DE),A */
 		PutBYTE(DE, hreg(AF));
-		break;
-	case 0x13:			/* INC DE */
+		NEXT;
+	CASE(0x13):			/* INC DE */
 		++DE;
-		break;
-	case 0x14:			/* INC D */
+		NEXT;
+	CASE(0x14):			/* INC D */
 		DE += 0x100;
 		temp = hreg(DE);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0) << 4) |
-			((temp == 0x80) << 2);
-		break;
-	case 0x15:			/* DEC D */
+		AF = (AF & ~0xfe) | inctab[temp & 0xff];
+		NEXT;
+	CASE(0x15):			/* DEC D */
 		DE -= 0x100;
 		temp = hreg(DE);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0xf) << 4) |
-			((temp == 0x7f) << 2) | 2;
-		break;
-	case 0x16:			/* LD D,nn */
+		AF = (AF & ~0xfe) | dectab[temp & 0xff];
+		NEXT;
+	CASE(0x16):			/* LD D,nn */
 		Sethreg(DE, GetBYTE_pp(PC));
-		break;
-	case 0x17:			/* RLA */
+		NEXT;
+	CASE(0x17):			/* RLA */
 		AF = ((AF << 8) & 0x0100) | ((AF >> 7) & 0x28) | ((AF << 1) & ~0x01ff) |
 			(AF & 0xc4) | ((AF >> 15) & 1);
-		break;
-	case 0x18:			/* JR dd */
+		NEXT;
+	CASE(0x18):			/* JR dd */
 		PC += (1) ? (signed char) GetBYTE(PC) + 1 : 1;
-		break;
-	case 0x19:			/* ADD HL,DE */
+		goto branched;
+	CASE(0x19):			/* ADD HL,DE */
 		HL &= 0xffff;
 		DE &= 0xffff;
 		sum = HL + DE;
@@ -256,73 +838,62 @@ simz80(FASTREG PC)
 		HL = sum;
 		AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
 			(cbits & 0x10) | ((cbits >> 8) & 1);
-		break;
-	case 0x1A:			/* LD A,(DE) */
+		NEXT;
+	CASE(0x1A):			/* LD A,(DE) */
 		Sethreg(AF, GetBYTE(DE));
-		break;
-	case 0x1B:			/* DEC DE */
+		NEXT;
+	CASE(0x1B):			/* DEC DE */
 		--DE;
-		break;
-	case 0x1C:			/* INC E */
+		NEXT;
+	CASE(0x1C):			/* INC E */
 		temp = lreg(DE)+1;
 		Setlreg(DE, temp);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0) << 4) |
-			((temp == 0x80) << 2);
-		break;
-	case 0x1D:			/* DEC E */
+		AF = (AF & ~0xfe) | inctab[temp & 0xff];
+		NEXT;
+	CASE(0x1D):			/* DEC E */
 		temp = lreg(DE)-1;
 		Setlreg(DE, temp);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0xf) << 4) |
-			((temp == 0x7f) << 2) | 2;
-		break;
-	case 0x1E:			/* LD E,nn */
+		AF = (AF & ~0xfe) | dectab[temp & 0xff];
+		NEXT;
+	CASE(0x1E):			/* LD E,nn */
 		Setlreg(DE, GetBYTE_pp(PC));
-		break;
-	case 0x1F:			/* RRA */
+		NEXT;
+	CASE(0x1F):			/* RRA */
 		temp = hreg(AF);
 		sum = temp >> 1;
 		AF = ((AF & 1) << 15) | (sum << 8) |
 			(sum & 0x28) | (AF & 0xc4) | (temp & 1);
-		break;
-	case 0x20:			/* JR NZ,dd */
+		NEXT;
+	CASE(0x20):			/* JR NZ,dd */
+		TAKEN(!TSTFLAG(Z), 5);
 		PC += (!TSTFLAG(Z)) ? (signed char) GetBYTE(PC) + 1 : 1;
-		break;
-	case 0x21:			/* LD HL,nnnn */
+		goto branched;
+	CASE(0x21):			/* LD HL,nnnn */
 		HL = GetWORD(PC);
 		PC += 2;
-		break;
-	case 0x22:			/* LD (nnnn),HL */
+		NEXT;
+	CASE(0x22):			/* LD (nnnn),HL */
 		temp = GetWORD(PC);
 		PutWORD(temp, HL);
 		PC += 2;
-		break;
-	case 0x23:			/* INC HL */
+		NEXT;
+	CASE(0x23):			/* INC HL */
 		++HL;
-		break;
-	case 0x24:			/* INC H */
+		NEXT;
+	CASE(0x24):			/* INC H */
 		HL += 0x100;
 		temp = hreg(HL);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0) << 4) |
-			((temp == 0x80) << 2);
-		break;
-	case 0x25:			/* DEC H */
+		AF = (AF & ~0xfe) | inctab[temp & 0xff];
+		NEXT;
+	CASE(0x25):			/* DEC H */
 		HL -= 0x100;
 		temp = hreg(HL);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0xf) << 4) |
-			((temp == 0x7f) << 2) | 2;
-		break;
-	case 0x26:			/* LD H,nn */
+		AF = (AF & ~0xfe) | dectab[temp & 0xff];
+		NEXT;
+	CASE(0x26):			/* LD H,nn */
 		Sethreg(HL, GetBYTE_pp(PC));
-		break;
-	case 0x27:			/* DAA */
+		NEXT;
+	CASE(0x27):			/* DAA */
 		acu = hreg(AF);
 		temp = ldig(acu);
 		cbits = TSTFLAG(C);
@@ -347,91 +918,81 @@ simz80(FASTREG PC)
 		}
 		cbits |= (acu >> 8) & 1;
 		acu &= 0xff;
-		AF = (acu << 8) | (acu & 0xa8) | ((acu == 0) << 6) |
-			(AF & 0x12) | partab[acu] | cbits;
-		break;
-	case 0x28:			/* JR Z,dd */
+		AF = (acu << 8) | szptab[acu] | (AF & 0x12) | cbits;
+		NEXT;
+	CASE(0x28):			/* JR Z,dd */
+		TAKEN(TSTFLAG(Z), 5);
 		PC += (TSTFLAG(Z)) ? (signed char) GetBYTE(PC) + 1 : 1;
-		break;
-	case 0x29:			/* ADD HL,HL */
+		goto branched;
+	CASE(0x29):			/* ADD HL,HL */
 		HL &= 0xffff;
 		sum = HL + HL;
 		cbits = (HL ^ HL ^ sum) >> 8;
 		HL = sum;
 		AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
 			(cbits & 0x10) | ((cbits >> 8) & 1);
-		break;
-	case 0x2A:			/* LD HL,(nnnn) */
+		NEXT;
+	CASE(0x2A):			/* LD HL,(nnnn) */
 		temp = GetWORD(PC);
 		HL = GetWORD(temp);
 		PC += 2;
-		break;
-	case 0x2B:			/* DEC HL */
+		NEXT;
+	CASE(0x2B):			/* DEC HL */
 		--HL;
-		break;
-	case 0x2C:			/* INC L */
+		NEXT;
+	CASE(0x2C):			/* INC L */
 		temp = lreg(HL)+1;
 		Setlreg(HL, temp);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0) << 4) |
-			((temp == 0x80) << 2);
-		break;
-	case 0x2D:			/* DEC L */
+		AF = (AF & ~0xfe) | inctab[temp & 0xff];
+		NEXT;
+	CASE(0x2D):			/* DEC L */
 		temp = lreg(HL)-1;
 		Setlreg(HL, temp);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0xf) << 4) |
-			((temp == 0x7f) << 2) | 2;
-		break;
-	case 0x2E:			/* LD L,nn */
+		AF = (AF & ~0xfe) | dectab[temp & 0xff];
+		NEXT;
+	CASE(0x2E):			/* LD L,nn */
 		Setlreg(HL, GetBYTE_pp(PC));
-		break;
-	case 0x2F:			/* CPL */
+		NEXT;
+	CASE(0x2F):			/* CPL */
 		AF = (~AF & ~0xff) | (AF & 0xc5) | ((~AF >> 8) & 0x28) | 0x12;
-		break;
-	case 0x30:			/* JR NC,dd */
+		NEXT;
+	CASE(0x30):			/* JR NC,dd */
+		TAKEN(!TSTFLAG(C), 5);
 		PC += (!TSTFLAG(C)) ? (signed char) GetBYTE(PC) + 1 : 1;
-		break;
-	case 0x31:			/* LD SP,nnnn */
+		goto branched;
+	CASE(0x31):			/* LD SP,nnnn */
 		SP = GetWORD(PC);
 		PC += 2;
-		break;
-	case 0x32:			/* LD (nnnn),A */
+		NEXT;
+	CASE(0x32):			/* LD (nnnn),A */
 		temp = GetWORD(PC);
 		PutBYTE(temp, hreg(AF));
 		PC += 2;
-		break;
-	case 0x33:			/* INC SP */
+		NEXT;
+	CASE(0x33):			/* INC SP */
 		++SP;
-		break;
-	case 0x34:			/* INC (HL) */
+		NEXT;
+	CASE(0x34):			/* INC (HL) */
 		temp = GetBYTE(HL)+1;
 		PutBYTE(HL, temp);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0) << 4) |
-			((temp == 0x80) << 2);
-		break;
-	case 0x35:			/* DEC (HL) */
+		AF = (AF & ~0xfe) | inctab[temp & 0xff];
+		NEXT;
+	CASE(0x35):			/* DEC (HL) */
 		temp = GetBYTE(HL)-1;
 		PutBYTE(HL, temp);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0xf) << 4) |
-			((temp == 0x7f) << 2) | 2;
-		break;
-	case 0x36:			/* LD (HL),nn */
+		AF = (AF & ~0xfe) | dectab[temp & 0xff];
+		NEXT;
+	CASE(0x36):			/* LD (HL),nn */
 		PutBYTE(HL, GetBYTE_pp(PC));
-		break;
-	case 0x37:			/* SCF */
+		NEXT;
+	CASE(0x37):			/* SCF */
 		AF = (AF&~0x3b)|((AF>>8)&0x28)|1;
-		break;
-	case 0x38:			/* JR C,dd */
+		NEXT;
+	CASE(0x38):			/* JR C,dd */
+		TAKEN(TSTFLAG(C), 5);
 		PC += (TSTFLAG(C)) ? (signed char) GetBYTE(PC) + 1 : 1;
-		break;
-	case 0x39:			/* ADD HL,SP */
+		goto branched;
+	CASE(0x39):			/* ADD HL,SP */
 		HL &= 0xffff;
 		SP &= 0xffff;
 		sum = HL + SP;
@@ -439,1798 +1000,1121 @@ simz80(FASTREG PC)
 		HL = sum;
 		AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
 			(cbits & 0x10) | ((cbits >> 8) & 1);
-		break;
-	case 0x3A:			/* LD A,(nnnn) */
+		NEXT;
+	CASE(0x3A):			/* LD A,(nnnn) */
 		temp = GetWORD(PC);
 		Sethreg(AF, GetBYTE(temp));
 		PC += 2;
-		break;
-	case 0x3B:			/* DEC SP */
+		NEXT;
+	CASE(0x3B):			/* DEC SP */
 		--SP;
-		break;
-	case 0x3C:			/* INC A */
+		NEXT;
+	CASE(0x3C):			/* INC A */
 		AF += 0x100;
 		temp = hreg(AF);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0) << 4) |
-			((temp == 0x80) << 2);
-		break;
-	case 0x3D:			/* DEC A */
+		AF = (AF & ~0xfe) | inctab[temp & 0xff];
+		NEXT;
+	CASE(0x3D):			/* DEC A */
 		AF -= 0x100;
 		temp = hreg(AF);
-		AF = (AF & ~0xfe) | (temp & 0xa8) |
-			(((temp & 0xff) == 0) << 6) |
-			(((temp & 0xf) == 0xf) << 4) |
-			((temp == 0x7f) << 2) | 2;
-		break;
-	case 0x3E:			/* LD A,nn */
+		AF = (AF & ~0xfe) | dectab[temp & 0xff];
+		NEXT;
+	CASE(0x3E):			/* LD A,nn */
 		Sethreg(AF, GetBYTE_pp(PC));
-		break;
-	case 0x3F:			/* CCF */
+		NEXT;
+	CASE(0x3F):			/* CCF */
 		AF = (AF&~0x3b)|((AF>>8)&0x28)|((AF&1)<<4)|(~AF&1);
-		break;
-	case 0x40:			/* LD B,B */
+		NEXT;
+	CASE(0x40):			/* LD B,B */
 		/* nop */
-		break;
-	case 0x41:			/* LD B,C */
+		NEXT;
+	CASE(0x41):			/* LD B,C */
 		BC = (BC & 255) | ((BC & 255) << 8);
-		break;
-	case 0x42:			/* LD B,D */
+		NEXT;
+	CASE(0x42):			/* LD B,D */
 		BC = (BC & 255) | (DE & ~255);
-		break;
-	case 0x43:			/* LD B,E */
+		NEXT;
+	CASE(0x43):			/* LD B,E */
 		BC = (BC & 255) | ((DE & 255) << 8);
-		break;
-	case 0x44:			/* LD B,H */
+		NEXT;
+	CASE(0x44):			/* LD B,H */
 		BC = (BC & 255) | (HL & ~255);
-		break;
-	case 0x45:			/* LD B,L */
+		NEXT;
+	CASE(0x45):			/* LD B,L */
 		BC = (BC & 255) | ((HL & 255) << 8);
-		break;
-	case 0x46:			/* LD B,(HL) */
+		NEXT;
+	CASE(0x46):			/* LD B,(HL) */
 		Sethreg(BC, GetBYTE(HL));
-		break;
-	case 0x47:			/* LD B,A */
+		NEXT;
+	CASE(0x47):			/* LD B,A */
 		BC = (BC & 255) | (AF & ~255);
-		break;
-	case 0x48:			/* LD C,B */
+		NEXT;
+	CASE(0x48):			/* LD C,B */
 		BC = (BC & ~255) | ((BC >> 8) & 255);
-		break;
-	case 0x49:			/* LD C,C */
+		NEXT;
+	CASE(0x49):			/* LD C,C */
 		/* nop */
-		break;
-	case 0x4A:			/* LD C,D */
+		NEXT;
+	CASE(0x4A):			/* LD C,D */
 		BC = (BC & ~255) | ((DE >> 8) & 255);
-		break;
-	case 0x4B:			/* LD C,E */
+		NEXT;
+	CASE(0x4B):			/* LD C,E */
 		BC = (BC & ~255) | (DE & 255);
-		break;
-	case 0x4C:			/* LD C,H */
+		NEXT;
+	CASE(0x4C):			/* LD C,H */
 		BC = (BC & ~255) | ((HL >> 8) & 255);
-		break;
-	case 0x4D:			/* LD C,L */
+		NEXT;
+	CASE(0x4D):			/* LD C,L */
 		BC = (BC & ~255) | (HL & 255);
-		break;
-	case 0x4E:			/* LD C,(HL) */
+		NEXT;
+	CASE(0x4E):			/* LD C,(HL) */
 		Setlreg(BC, GetBYTE(HL));
-		break;
-	case 0x4F:			/* LD C,A */
+		NEXT;
+	CASE(0x4F):			/* LD C,A */
 		BC = (BC & ~255) | ((AF >> 8) & 255);
-		break;
-	case 0x50:			/* LD D,B */
+		NEXT;
+	CASE(0x50):			/* LD D,B */
 		DE = (DE & 255) | (BC & ~255);
-		break;
-	case 0x51:			/* LD D,C */
+		NEXT;
+	CASE(0x51):			/* LD D,C */
 		DE = (DE & 255) | ((BC & 255) << 8);
-		break;
-	case 0x52:			/* LD D,D */
+		NEXT;
+	CASE(0x52):			/* LD D,D */
 		/* nop */
-		break;
-	case 0x53:			/* LD D,E */
+		NEXT;
+	CASE(0x53):			/* LD D,E */
 		DE = (DE & 255) | ((DE & 255) << 8);
-		break;
-	case 0x54:			/* LD D,H */
+		NEXT;
+	CASE(0x54):			/* LD D,H */
 		DE = (DE & 255) | (HL & ~255);
-		break;
-	case 0x55:			/* LD D,L */
+		NEXT;
+	CASE(0x55):			/* LD D,L */
 		DE = (DE & 255) | ((HL & 255) << 8);
-		break;
-	case 0x56:			/* LD D,(HL) */
+		NEXT;
+	CASE(0x56):			/* LD D,(HL) */
 		Sethreg(DE, GetBYTE(HL));
-		break;
-	case 0x57:			/* LD D,A */
+		NEXT;
+	CASE(0x57):			/* LD D,A */
 		DE = (DE & 255) | (AF & ~255);
-		break;
-	case 0x58:			/* LD E,B */
+		NEXT;
+	CASE(0x58):			/* LD E,B */
 		DE = (DE & ~255) | ((BC >> 8) & 255);
-		break;
-	case 0x59:			/* LD E,C */
+		NEXT;
+	CASE(0x59):			/* LD E,C */
 		DE = (DE & ~255) | (BC & 255);
-		break;
-	case 0x5A:			/* LD E,D */
+		NEXT;
+	CASE(0x5A):			/* LD E,D */
 		DE = (DE & ~255) | ((DE >> 8) & 255);
-		break;
-	case 0x5B:			/* LD E,E */
+		NEXT;
+	CASE(0x5B):			/* LD E,E */
 		/* nop */
-		break;
-	case 0x5C:			/* LD E,H */
+		NEXT;
+	CASE(0x5C):			/* LD E,H */
 		DE = (DE & ~255) | ((HL >> 8) & 255);
-		break;
-	case 0x5D:			/* LD E,L */
+		NEXT;
+	CASE(0x5D):			/* LD E,L */
 		DE = (DE & ~255) | (HL & 255);
-		break;
-	case 0x5E:			/* LD E,(HL) */
+		NEXT;
+	CASE(0x5E):			/* LD E,(HL) */
 		Setlreg(DE, GetBYTE(HL));
-		break;
-	case 0x5F:			/* LD E,A */
+		NEXT;
+	CASE(0x5F):			/* LD E,A */
 		DE = (DE & ~255) | ((AF >> 8) & 255);
-		break;
-	case 0x60:			/* LD H,B */
+		NEXT;
+	CASE(0x60):			/* LD H,B */
 		HL = (HL & 255) | (BC & ~255);
-		break;
-	case 0x61:			/* LD H,C */
+		NEXT;
+	CASE(0x61):			/* LD H,C */
 		HL = (HL & 255) | ((BC & 255) << 8);
-		break;
-	case 0x62:			/* LD H,D */
+		NEXT;
+	CASE(0x62):			/* LD H,D */
 		HL = (HL & 255) | (DE & ~255);
-		break;
-	case 0x63:			/* LD H,E */
+		NEXT;
+	CASE(0x63):			/* LD H,E */
 		HL = (HL & 255) | ((DE & 255) << 8);
-		break;
-	case 0x64:			/* LD H,H */
+		NEXT;
+	CASE(0x64):			/* LD H,H */
 		/* nop */
-		break;
-	case 0x65:			/* LD H,L */
+		NEXT;
+	CASE(0x65):			/* LD H,L */
 		HL = (HL & 255) | ((HL & 255) << 8);
-		break;
-	case 0x66:			/* LD H,(HL) */
+		NEXT;
+	CASE(0x66):			/* LD H,(HL) */
 		Sethreg(HL, GetBYTE(HL));
-		break;
-	case 0x67:			/* LD H,A */
+		NEXT;
+	CASE(0x67):			/* LD H,A */
 		HL = (HL & 255) | (AF & ~255);
-		break;
-	case 0x68:			/* LD L,B */
+		NEXT;
+	CASE(0x68):			/* LD L,B */
 		HL = (HL & ~255) | ((BC >> 8) & 255);
-		break;
-	case 0x69:			/* LD L,C */
+		NEXT;
+	CASE(0x69):			/* LD L,C */
 		HL = (HL & ~255) | (BC & 255);
-		break;
-	case 0x6A:			/* LD L,D */
+		NEXT;
+	CASE(0x6A):			/* LD L,D */
 		HL = (HL & ~255) | ((DE >> 8) & 255);
-		break;
-	case 0x6B:			/* LD L,E */
+		NEXT;
+	CASE(0x6B):			/* LD L,E */
 		HL = (HL & ~255) | (DE & 255);
-		break;
-	case 0x6C:			/* LD L,H */
+		NEXT;
+	CASE(0x6C):			/* LD L,H */
 		HL = (HL & ~255) | ((HL >> 8) & 255);
-		break;
-	case 0x6D:			/* LD L,L */
+		NEXT;
+	CASE(0x6D):			/* LD L,L */
 		/* nop */
-		break;
-	case 0x6E:			/* LD L,(HL) */
+		NEXT;
+	CASE(0x6E):			/* LD L,(HL) */
 		Setlreg(HL, GetBYTE(HL));
-		break;
-	case 0x6F:			/* LD L,A */
+		NEXT;
+	CASE(0x6F):			/* LD L,A */
 		HL = (HL & ~255) | ((AF >> 8) & 255);
-		break;
-	case 0x70:			/* LD (HL),B */
+		NEXT;
+	CASE(0x70):			/* LD (HL),B */
 		PutBYTE(HL, hreg(BC));
-		break;
-	case 0x71:			/* LD (HL),C */
+		NEXT;
+	CASE(0x71):			/* LD (HL),C */
 		PutBYTE(HL, lreg(BC));
-		break;
-	case 0x72:			/* LD (HL),D */
+		NEXT;
+	CASE(0x72):			/* LD (HL),D */
 		PutBYTE(HL, hreg(DE));
-		break;
-	case 0x73:			/* LD (HL),E */
+		NEXT;
+	CASE(0x73):			/* LD (HL),E */
 		PutBYTE(HL, lreg(DE));
-		break;
-	case 0x74:			/* LD (HL),H */
+		NEXT;
+	CASE(0x74):			/* LD (HL),H */
 		PutBYTE(HL, hreg(HL));
-		break;
-	case 0x75:			/* LD (HL),L */
+		NEXT;
+	CASE(0x75):			/* LD (HL),L */
 		PutBYTE(HL, lreg(HL));
-		break;
-	case 0x76:			/* HALT */
-		SAVE_STATE();
-		return PC&0xffff;
-	case 0x77:			/* LD (HL),A */
+		NEXT;
+	CASE(0x76):			/* HALT */
+		reason = STOP_HALT;
+		goto stop;
+	CASE(0x77):			/* LD (HL),A */
 		PutBYTE(HL, hreg(AF));
-		break;
-	case 0x78:			/* LD A,B */
+		NEXT;
+	CASE(0x78):			/* LD A,B */
 		AF = (AF & 255) | (BC & ~255);
-		break;
-	case 0x79:			/* LD A,C */
+		NEXT;
+	CASE(0x79):			/* LD A,C */
 		AF = (AF & 255) | ((BC & 255) << 8);
-		break;
-	case 0x7A:			/* LD A,D */
+		NEXT;
+	CASE(0x7A):			/* LD A,D */
 		AF = (AF & 255) | (DE & ~255);
-		break;
-	case 0x7B:			/* LD A,E */
+		NEXT;
+	CASE(0x7B):			/* LD A,E */
 		AF = (AF & 255) | ((DE & 255) << 8);
-		break;
-	case 0x7C:			/* LD A,H */
+		NEXT;
+	CASE(0x7C):			/* LD A,H */
 		AF = (AF & 255) | (HL & ~255);
-		break;
-	case 0x7D:			/* LD A,L */
+		NEXT;
+	CASE(0x7D):			/* LD A,L */
 		AF = (AF & 255) | ((HL & 255) << 8);
-		break;
-	case 0x7E:			/* LD A,(HL) */
+		NEXT;
+	CASE(0x7E):			/* LD A,(HL) */
 		Sethreg(AF, GetBYTE(HL));
-		break;
-	case 0x7F:			/* LD A,A */
+		NEXT;
+	CASE(0x7F):			/* LD A,A */
 		/* nop */
-		break;
-	case 0x80:			/* ADD A,B */
+		NEXT;
+	CASE(0x80):			/* ADD A,B */
 		temp = hreg(BC);
 		acu = hreg(AF);
 		sum = acu + temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x81:			/* ADD A,C */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x81):			/* ADD A,C */
 		temp = lreg(BC);
 		acu = hreg(AF);
 		sum = acu + temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x82:			/* ADD A,D */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x82):			/* ADD A,D */
 		temp = hreg(DE);
 		acu = hreg(AF);
 		sum = acu + temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x83:			/* ADD A,E */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x83):			/* ADD A,E */
 		temp = lreg(DE);
 		acu = hreg(AF);
 		sum = acu + temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x84:			/* ADD A,H */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x84):			/* ADD A,H */
 		temp = hreg(HL);
 		acu = hreg(AF);
 		sum = acu + temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x85:			/* ADD A,L */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x85):			/* ADD A,L */
 		temp = lreg(HL);
 		acu = hreg(AF);
 		sum = acu + temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x86:			/* ADD A,(HL) */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x86):			/* ADD A,(HL) */
 		temp = GetBYTE(HL);
 		acu = hreg(AF);
 		sum = acu + temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x87:			/* ADD A,A */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x87):			/* ADD A,A */
 		temp = hreg(AF);
 		acu = hreg(AF);
 		sum = acu + temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x88:			/* ADC A,B */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x88):			/* ADC A,B */
 		temp = hreg(BC);
 		acu = hreg(AF);
 		sum = acu + temp + TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x89:			/* ADC A,C */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x89):			/* ADC A,C */
 		temp = lreg(BC);
 		acu = hreg(AF);
 		sum = acu + temp + TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x8A:			/* ADC A,D */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x8A):			/* ADC A,D */
 		temp = hreg(DE);
 		acu = hreg(AF);
 		sum = acu + temp + TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x8B:			/* ADC A,E */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x8B):			/* ADC A,E */
 		temp = lreg(DE);
 		acu = hreg(AF);
 		sum = acu + temp + TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x8C:			/* ADC A,H */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x8C):			/* ADC A,H */
 		temp = hreg(HL);
 		acu = hreg(AF);
 		sum = acu + temp + TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x8D:			/* ADC A,L */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x8D):			/* ADC A,L */
 		temp = lreg(HL);
 		acu = hreg(AF);
 		sum = acu + temp + TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x8E:			/* ADC A,(HL) */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x8E):			/* ADC A,(HL) */
 		temp = GetBYTE(HL);
 		acu = hreg(AF);
 		sum = acu + temp + TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x8F:			/* ADC A,A */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x8F):			/* ADC A,A */
 		temp = hreg(AF);
 		acu = hreg(AF);
 		sum = acu + temp + TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0x90:			/* SUB B */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0x90):			/* SUB B */
 		temp = hreg(BC);
 		acu = hreg(AF);
 		sum = acu - temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0x91:			/* SUB C */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0x91):			/* SUB C */
 		temp = lreg(BC);
 		acu = hreg(AF);
 		sum = acu - temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0x92:			/* SUB D */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0x92):			/* SUB D */
 		temp = hreg(DE);
 		acu = hreg(AF);
 		sum = acu - temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0x93:			/* SUB E */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0x93):			/* SUB E */
 		temp = lreg(DE);
 		acu = hreg(AF);
 		sum = acu - temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0x94:			/* SUB H */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0x94):			/* SUB H */
 		temp = hreg(HL);
 		acu = hreg(AF);
 		sum = acu - temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0x95:			/* SUB L */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0x95):			/* SUB L */
 		temp = lreg(HL);
 		acu = hreg(AF);
 		sum = acu - temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0x96:			/* SUB (HL) */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0x96):			/* SUB (HL) */
 		temp = GetBYTE(HL);
 		acu = hreg(AF);
 		sum = acu - temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0x97:			/* SUB A */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0x97):			/* SUB A */
 		temp = hreg(AF);
 		acu = hreg(AF);
 		sum = acu - temp;
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0x98:			/* SBC A,B */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0x98):			/* SBC A,B */
 		temp = hreg(BC);
 		acu = hreg(AF);
 		sum = acu - temp - TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0x99:			/* SBC A,C */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0x99):			/* SBC A,C */
 		temp = lreg(BC);
 		acu = hreg(AF);
 		sum = acu - temp - TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0x9A:			/* SBC A,D */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0x9A):			/* SBC A,D */
 		temp = hreg(DE);
 		acu = hreg(AF);
 		sum = acu - temp - TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0x9B:			/* SBC A,E */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0x9B):			/* SBC A,E */
 		temp = lreg(DE);
 		acu = hreg(AF);
 		sum = acu - temp - TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0x9C:			/* SBC A,H */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0x9C):			/* SBC A,H */
 		temp = hreg(HL);
 		acu = hreg(AF);
 		sum = acu - temp - TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0x9D:			/* SBC A,L */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0x9D):			/* SBC A,L */
 		temp = lreg(HL);
 		acu = hreg(AF);
 		sum = acu - temp - TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0x9E:			/* SBC A,(HL) */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0x9E):			/* SBC A,(HL) */
 		temp = GetBYTE(HL);
 		acu = hreg(AF);
 		sum = acu - temp - TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0x9F:			/* SBC A,A */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0x9F):			/* SBC A,A */
 		temp = hreg(AF);
 		acu = hreg(AF);
 		sum = acu - temp - TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0xA0:			/* AND B */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0xA0):			/* AND B */
 		sum = ((AF & (BC)) >> 8) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) |
-			((sum == 0) << 6) | 0x10 | partab[sum];
-		break;
-	case 0xA1:			/* AND C */
+		AF = (sum << 8) | szptab[sum] | 0x10;
+		NEXT;
+	CASE(0xA1):			/* AND C */
 		sum = ((AF >> 8) & BC) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-			((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xA2:			/* AND D */
+		AF = (sum << 8) | szptab[sum] | 0x10;
+		NEXT;
+	CASE(0xA2):			/* AND D */
 		sum = ((AF & (DE)) >> 8) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) |
-			((sum == 0) << 6) | 0x10 | partab[sum];
-		break;
-	case 0xA3:			/* AND E */
+		AF = (sum << 8) | szptab[sum] | 0x10;
+		NEXT;
+	CASE(0xA3):			/* AND E */
 		sum = ((AF >> 8) & DE) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-			((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xA4:			/* AND H */
+		AF = (sum << 8) | szptab[sum] | 0x10;
+		NEXT;
+	CASE(0xA4):			/* AND H */
 		sum = ((AF & (HL)) >> 8) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) |
-			((sum == 0) << 6) | 0x10 | partab[sum];
-		break;
-	case 0xA5:			/* AND L */
+		AF = (sum << 8) | szptab[sum] | 0x10;
+		NEXT;
+	CASE(0xA5):			/* AND L */
 		sum = ((AF >> 8) & HL) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-			((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xA6:			/* AND (HL) */
+		AF = (sum << 8) | szptab[sum] | 0x10;
+		NEXT;
+	CASE(0xA6):			/* AND (HL) */
 		sum = ((AF >> 8) & GetBYTE(HL)) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-			((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xA7:			/* AND A */
+		AF = (sum << 8) | szptab[sum] | 0x10;
+		NEXT;
+	CASE(0xA7):			/* AND A */
 		sum = ((AF & (AF)) >> 8) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) |
-			((sum == 0) << 6) | 0x10 | partab[sum];
-		break;
-	case 0xA8:			/* XOR B */
+		AF = (sum << 8) | szptab[sum] | 0x10;
+		NEXT;
+	CASE(0xA8):			/* XOR B */
 		sum = ((AF ^ (BC)) >> 8) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xA9:			/* XOR C */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xA9):			/* XOR C */
 		sum = ((AF >> 8) ^ BC) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xAA:			/* XOR D */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xAA):			/* XOR D */
 		sum = ((AF ^ (DE)) >> 8) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xAB:			/* XOR E */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xAB):			/* XOR E */
 		sum = ((AF >> 8) ^ DE) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xAC:			/* XOR H */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xAC):			/* XOR H */
 		sum = ((AF ^ (HL)) >> 8) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xAD:			/* XOR L */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xAD):			/* XOR L */
 		sum = ((AF >> 8) ^ HL) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xAE:			/* XOR (HL) */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xAE):			/* XOR (HL) */
 		sum = ((AF >> 8) ^ GetBYTE(HL)) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xAF:			/* XOR A */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xAF):			/* XOR A */
 		sum = ((AF ^ (AF)) >> 8) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xB0:			/* OR B */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xB0):			/* OR B */
 		sum = ((AF | (BC)) >> 8) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xB1:			/* OR C */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xB1):			/* OR C */
 		sum = ((AF >> 8) | BC) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xB2:			/* OR D */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xB2):			/* OR D */
 		sum = ((AF | (DE)) >> 8) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xB3:			/* OR E */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xB3):			/* OR E */
 		sum = ((AF >> 8) | DE) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xB4:			/* OR H */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xB4):			/* OR H */
 		sum = ((AF | (HL)) >> 8) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xB5:			/* OR L */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xB5):			/* OR L */
 		sum = ((AF >> 8) | HL) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xB6:			/* OR (HL) */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xB6):			/* OR (HL) */
 		sum = ((AF >> 8) | GetBYTE(HL)) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xB7:			/* OR A */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xB7):			/* OR A */
 		sum = ((AF | (AF)) >> 8) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xB8:			/* CP B */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xB8):			/* CP B */
 		temp = hreg(BC);
 		AF = (AF & ~0x28) | (temp & 0x28);
 		acu = hreg(AF);
 		sum = acu - temp;
 		cbits = acu ^ temp ^ sum;
-		AF = (AF & ~0xff) | (sum & 0x80) |
-			(((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			(cbits & 0x10) | ((cbits >> 8) & 1);
-		break;
-	case 0xB9:			/* CP C */
+		AF = (AF & ~0xff) | (sztab[sum & 0xff] & 0xc0) | (temp & 0x28) |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0xB9):			/* CP C */
 		temp = lreg(BC);
 		AF = (AF & ~0x28) | (temp & 0x28);
 		acu = hreg(AF);
 		sum = acu - temp;
 		cbits = acu ^ temp ^ sum;
-		AF = (AF & ~0xff) | (sum & 0x80) |
-			(((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			(cbits & 0x10) | ((cbits >> 8) & 1);
-		break;
-	case 0xBA:			/* CP D */
+		AF = (AF & ~0xff) | (sztab[sum & 0xff] & 0xc0) | (temp & 0x28) |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0xBA):			/* CP D */
 		temp = hreg(DE);
 		AF = (AF & ~0x28) | (temp & 0x28);
 		acu = hreg(AF);
-		sum = acu - temp;
-		cbits = acu ^ temp ^ sum;
-		AF = (AF & ~0xff) | (sum & 0x80) |
-			(((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			(cbits & 0x10) | ((cbits >> 8) & 1);
-		break;
-	case 0xBB:			/* CP E */
-		temp = lreg(DE);
-		AF = (AF & ~0x28) | (temp & 0x28);
-		acu = hreg(AF);
-		sum = acu - temp;
-		cbits = acu ^ temp ^ sum;
-		AF = (AF & ~0xff) | (sum & 0x80) |
-			(((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			(cbits & 0x10) | ((cbits >> 8) & 1);
-		break;
-	case 0xBC:			/* CP H */
-		temp = hreg(HL);
-		AF = (AF & ~0x28) | (temp & 0x28);
-		acu = hreg(AF);
-		sum = acu - temp;
-		cbits = acu ^ temp ^ sum;
-		AF = (AF & ~0xff) | (sum & 0x80) |
-			(((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			(cbits & 0x10) | ((cbits >> 8) & 1);
-		break;
-	case 0xBD:			/* CP L */
-		temp = lreg(HL);
-		AF = (AF & ~0x28) | (temp & 0x28);
-		acu = hreg(AF);
-		sum = acu - temp;
-		cbits = acu ^ temp ^ sum;
-		AF = (AF & ~0xff) | (sum & 0x80) |
-			(((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			(cbits & 0x10) | ((cbits >> 8) & 1);
-		break;
-	case 0xBE:			/* CP (HL) */
-		temp = GetBYTE(HL);
-		AF = (AF & ~0x28) | (temp & 0x28);
-		acu = hreg(AF);
-		sum = acu - temp;
-		cbits = acu ^ temp ^ sum;
-		AF = (AF & ~0xff) | (sum & 0x80) |
-			(((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			(cbits & 0x10) | ((cbits >> 8) & 1);
-		break;
-	case 0xBF:			/* CP A */
-		temp = hreg(AF);
-		AF = (AF & ~0x28) | (temp & 0x28);
-		acu = hreg(AF);
-		sum = acu - temp;
-		cbits = acu ^ temp ^ sum;
-		AF = (AF & ~0xff) | (sum & 0x80) |
-			(((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			(cbits & 0x10) | ((cbits >> 8) & 1);
-		break;
-	case 0xC0:			/* RET NZ */
-		if (!TSTFLAG(Z)) POP(PC);
-		break;
-	case 0xC1:			/* POP BC */
-		POP(BC);
-		break;
-	case 0xC2:			/* JP NZ,nnnn */
-		JPC(!TSTFLAG(Z));
-		break;
-	case 0xC3:			/* JP nnnn */
-		JPC(1);
-		break;
-	case 0xC4:			/* CALL NZ,nnnn */
-		CALLC(!TSTFLAG(Z));
-		break;
-	case 0xC5:			/* PUSH BC */
-		PUSH(BC);
-		break;
-	case 0xC6:			/* ADD A,nn */
-		temp = GetBYTE_pp(PC);
-		acu = hreg(AF);
-		sum = acu + temp;
-		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0xC7:			/* RST 0 */
-		PUSH(PC); PC = 0;
-		break;
-	case 0xC8:			/* RET Z */
-		if (TSTFLAG(Z)) POP(PC);
-		break;
-	case 0xC9:			/* RET */
-		POP(PC);
-		break;
-	case 0xCA:			/* JP Z,nnnn */
-		JPC(TSTFLAG(Z));
-		break;
-	case 0xCB:			/* CB prefix */
-		adr = HL;
-		switch ((op = GetBYTE(PC)) & 7) {
-		case 0: ++PC; acu = hreg(BC); break;
-		case 1: ++PC; acu = lreg(BC); break;
-		case 2: ++PC; acu = hreg(DE); break;
-		case 3: ++PC; acu = lreg(DE); break;
-		case 4: ++PC; acu = hreg(HL); break;
-		case 5: ++PC; acu = lreg(HL); break;
-		case 6: ++PC; acu = GetBYTE(adr);  break;
-		case 7: ++PC; acu = hreg(AF); break;
-		}
-		switch (op & 0xc0) {
-		case 0x00:		/* shift/rotate */
-			switch (op & 0x38) {
-			case 0x00:	/* RLC */
-				temp = (acu << 1) | (acu >> 7);
-				cbits = temp & 1;
-				goto cbshflg1;
-			case 0x08:	/* RRC */
-				temp = (acu >> 1) | (acu << 7);
-				cbits = temp & 0x80;
-				goto cbshflg1;
-			case 0x10:	/* RL */
-				temp = (acu << 1) | TSTFLAG(C);
-				cbits = acu & 0x80;
-				goto cbshflg1;
-			case 0x18:	/* RR */
-				temp = (acu >> 1) | (TSTFLAG(C) << 7);
-				cbits = acu & 1;
-				goto cbshflg1;
-			case 0x20:	/* SLA */
-				temp = acu << 1;
-				cbits = acu & 0x80;
-				goto cbshflg1;
-			case 0x28:	/* SRA */
-				temp = (acu >> 1) | (acu & 0x80);
-				cbits = acu & 1;
-				goto cbshflg1;
-			case 0x30:	/* SLIA */
-				temp = (acu << 1) | 1;
-				cbits = acu & 0x80;
-				goto cbshflg1;
-			case 0x38:	/* SRL */
-				temp = acu >> 1;
-				cbits = acu & 1;
-			cbshflg1:
-				AF = (AF & ~0xff) | (temp & 0xa8) |
-					(((temp & 0xff) == 0) << 6) |
-					parity(temp) | !!cbits;
-			}
-			break;
-		case 0x40:		/* BIT */
-			if (acu & (1 << ((op >> 3) & 7)))
-				AF = (AF & ~0xfe) | 0x10 |
-				(((op & 0x38) == 0x38) << 7);
-			else
-				AF = (AF & ~0xfe) | 0x54;
-			if ((op&7) != 6)
-				AF |= (acu & 0x28);
-			temp = acu;
-			break;
-		case 0x80:		/* RES */
-			temp = acu & ~(1 << ((op >> 3) & 7));
-			break;
-		case 0xc0:		/* SET */
-			temp = acu | (1 << ((op >> 3) & 7));
-			break;
-		}
-		switch (op & 7) {
-		case 0: Sethreg(BC, temp); break;
-		case 1: Setlreg(BC, temp); break;
-		case 2: Sethreg(DE, temp); break;
-		case 3: Setlreg(DE, temp); break;
-		case 4: Sethreg(HL, temp); break;
-		case 5: Setlreg(HL, temp); break;
-		case 6: PutBYTE(adr, temp);  break;
-		case 7: Sethreg(AF, temp); break;
-		}
-		break;
-	case 0xCC:			/* CALL Z,nnnn */
-		CALLC(TSTFLAG(Z));
-		break;
-	case 0xCD:			/* CALL nnnn */
-		CALLC(1);
-		break;
-	case 0xCE:			/* ADC A,nn */
-		temp = GetBYTE_pp(PC);
-		acu = hreg(AF);
-		sum = acu + temp + TSTFLAG(C);
-		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-			((cbits >> 8) & 1);
-		break;
-	case 0xCF:			/* RST 8 */
-		PUSH(PC); PC = 8;
-		break;
-	case 0xD0:			/* RET NC */
-		if (!TSTFLAG(C)) POP(PC);
-		break;
-	case 0xD1:			/* POP DE */
-		POP(DE);
-		break;
-	case 0xD2:			/* JP NC,nnnn */
-		JPC(!TSTFLAG(C));
-		break;
-	case 0xD3:			/* OUT (nn),A */
-		Output(GetBYTE_pp(PC), hreg(AF));
-		break;
-	case 0xD4:			/* CALL NC,nnnn */
-		CALLC(!TSTFLAG(C));
-		break;
-	case 0xD5:			/* PUSH DE */
-		PUSH(DE);
-		break;
-	case 0xD6:			/* SUB nn */
-		temp = GetBYTE_pp(PC);
-		acu = hreg(AF);
-		sum = acu - temp;
-		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0xD7:			/* RST 10H */
-		PUSH(PC); PC = 0x10;
-		break;
-	case 0xD8:			/* RET C */
-		if (TSTFLAG(C)) POP(PC);
-		break;
-	case 0xD9:			/* EXX */
-		regs[regs_sel].bc = BC;
-		regs[regs_sel].de = DE;
-		regs[regs_sel].hl = HL;
-		regs_sel = 1 - regs_sel;
-		BC = regs[regs_sel].bc;
-		DE = regs[regs_sel].de;
-		HL = regs[regs_sel].hl;
-		break;
-	case 0xDA:			/* JP C,nnnn */
-		JPC(TSTFLAG(C));
-		break;
-	case 0xDB:			/* IN A,(nn) */
-		Sethreg(AF, Input(GetBYTE_pp(PC)));
-		break;
-	case 0xDC:			/* CALL C,nnnn */
-		CALLC(TSTFLAG(C));
-		break;
-	case 0xDD:			/* DD prefix */
-		switch (op = GetBYTE_pp(PC)) {
-		case 0x09:			/* ADD IX,BC */
-			IX &= 0xffff;
-			BC &= 0xffff;
-			sum = IX + BC;
-			cbits = (IX ^ BC ^ sum) >> 8;
-			IX = sum;
-			AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
-				(cbits & 0x10) | ((cbits >> 8) & 1);
-			break;
-		case 0x19:			/* ADD IX,DE */
-			IX &= 0xffff;
-			DE &= 0xffff;
-			sum = IX + DE;
-			cbits = (IX ^ DE ^ sum) >> 8;
-			IX = sum;
-			AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
-				(cbits & 0x10) | ((cbits >> 8) & 1);
-			break;
-		case 0x21:			/* LD IX,nnnn */
-			IX = GetWORD(PC);
-			PC += 2;
-			break;
-		case 0x22:			/* LD (nnnn),IX */
-			temp = GetWORD(PC);
-			PutWORD(temp, IX);
-			PC += 2;
-			break;
-		case 0x23:			/* INC IX */
-			++IX;
-			break;
-		case 0x24:			/* INC IXH */
-			IX += 0x100;
-			temp = hreg(IX);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				(((temp & 0xf) == 0) << 4) |
-				((temp == 0x80) << 2);
-			break;
-		case 0x25:			/* DEC IXH */
-			IX -= 0x100;
-			temp = hreg(IX);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				(((temp & 0xf) == 0xf) << 4) |
-				((temp == 0x7f) << 2) | 2;
-			break;
-		case 0x26:			/* LD IXH,nn */
-			Sethreg(IX, GetBYTE_pp(PC));
-			break;
-		case 0x29:			/* ADD IX,IX */
-			IX &= 0xffff;
-			sum = IX + IX;
-			cbits = (IX ^ IX ^ sum) >> 8;
-			IX = sum;
-			AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
-				(cbits & 0x10) | ((cbits >> 8) & 1);
-			break;
-		case 0x2A:			/* LD IX,(nnnn) */
-			temp = GetWORD(PC);
-			IX = GetWORD(temp);
-			PC += 2;
-			break;
-		case 0x2B:			/* DEC IX */
-			--IX;
-			break;
-		case 0x2C:			/* INC IXL */
-			temp = lreg(IX)+1;
-			Setlreg(IX, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				(((temp & 0xf) == 0) << 4) |
-				((temp == 0x80) << 2);
-			break;
-		case 0x2D:			/* DEC IXL */
-			temp = lreg(IX)-1;
-			Setlreg(IX, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				(((temp & 0xf) == 0xf) << 4) |
-				((temp == 0x7f) << 2) | 2;
-			break;
-		case 0x2E:			/* LD IXL,nn */
-			Setlreg(IX, GetBYTE_pp(PC));
-			break;
-		case 0x34:			/* INC (IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			temp = GetBYTE(adr)+1;
-			PutBYTE(adr, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				(((temp & 0xf) == 0) << 4) |
-				((temp == 0x80) << 2);
-			break;
-		case 0x35:			/* DEC (IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			temp = GetBYTE(adr)-1;
-			PutBYTE(adr, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				(((temp & 0xf) == 0xf) << 4) |
-				((temp == 0x7f) << 2) | 2;
-			break;
-		case 0x36:			/* LD (IX+dd),nn */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			PutBYTE(adr, GetBYTE_pp(PC));
-			break;
-		case 0x39:			/* ADD IX,SP */
-			IX &= 0xffff;
-			SP &= 0xffff;
-			sum = IX + SP;
-			cbits = (IX ^ SP ^ sum) >> 8;
-			IX = sum;
-			AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
-				(cbits & 0x10) | ((cbits >> 8) & 1);
-			break;
-		case 0x44:			/* LD B,IXH */
-			Sethreg(BC, hreg(IX));
-			break;
-		case 0x45:			/* LD B,IXL */
-			Sethreg(BC, lreg(IX));
-			break;
-		case 0x46:			/* LD B,(IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			Sethreg(BC, GetBYTE(adr));
-			break;
-		case 0x4C:			/* LD C,IXH */
-			Setlreg(BC, hreg(IX));
-			break;
-		case 0x4D:			/* LD C,IXL */
-			Setlreg(BC, lreg(IX));
-			break;
-		case 0x4E:			/* LD C,(IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			Setlreg(BC, GetBYTE(adr));
-			break;
-		case 0x54:			/* LD D,IXH */
-			Sethreg(DE, hreg(IX));
-			break;
-		case 0x55:			/* LD D,IXL */
-			Sethreg(DE, lreg(IX));
-			break;
-		case 0x56:			/* LD D,(IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			Sethreg(DE, GetBYTE(adr));
-			break;
-		case 0x5C:			/* LD E,H */
-			Setlreg(DE, hreg(IX));
-			break;
-		case 0x5D:			/* LD E,L */
-			Setlreg(DE, lreg(IX));
-			break;
-		case 0x5E:			/* LD E,(IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			Setlreg(DE, GetBYTE(adr));
-			break;
-		case 0x60:			/* LD IXH,B */
-			Sethreg(IX, hreg(BC));
-			break;
-		case 0x61:			/* LD IXH,C */
-			Sethreg(IX, lreg(BC));
-			break;
-		case 0x62:			/* LD IXH,D */
-			Sethreg(IX, hreg(DE));
-			break;
-		case 0x63:			/* LD IXH,E */
-			Sethreg(IX, lreg(DE));
-			break;
-		case 0x64:			/* LD IXH,IXH */
-			/* nop */
-			break;
-		case 0x65:			/* LD IXH,IXL */
-			Sethreg(IX, lreg(IX));
-			break;
-		case 0x66:			/* LD H,(IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			Sethreg(HL, GetBYTE(adr));
-			break;
-		case 0x67:			/* LD IXH,A */
-			Sethreg(IX, hreg(AF));
-			break;
-		case 0x68:			/* LD IXL,B */
-			Setlreg(IX, hreg(BC));
-			break;
-		case 0x69:			/* LD IXL,C */
-			Setlreg(IX, lreg(BC));
-			break;
-		case 0x6A:			/* LD IXL,D */
-			Setlreg(IX, hreg(DE));
-			break;
-		case 0x6B:			/* LD IXL,E */
-			Setlreg(IX, lreg(DE));
-			break;
-		case 0x6C:			/* LD IXL,IXH */
-			Setlreg(IX, hreg(IX));
-			break;
-		case 0x6D:			/* LD IXL,IXL */
-			/* nop */
-			break;
-		case 0x6E:			/* LD L,(IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			Setlreg(HL, GetBYTE(adr));
-			break;
-		case 0x6F:			/* LD IXL,A */
-			Setlreg(IX, hreg(AF));
-			break;
-		case 0x70:			/* LD (IX+dd),B */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			PutBYTE(adr, hreg(BC));
-			break;
-		case 0x71:			/* LD (IX+dd),C */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			PutBYTE(adr, lreg(BC));
-			break;
-		case 0x72:			/* LD (IX+dd),D */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			PutBYTE(adr, hreg(DE));
-			break;
-		case 0x73:			/* LD (IX+dd),E */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			PutBYTE(adr, lreg(DE));
-			break;
-		case 0x74:			/* LD (IX+dd),H */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			PutBYTE(adr, hreg(HL));
-			break;
-		case 0x75:			/* LD (IX+dd),L */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			PutBYTE(adr, lreg(HL));
-			break;
-		case 0x77:			/* LD (IX+dd),A */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			PutBYTE(adr, hreg(AF));
-			break;
-		case 0x7C:			/* LD A,IXH */
-			Sethreg(AF, hreg(IX));
-			break;
-		case 0x7D:			/* LD A,IXL */
-			Sethreg(AF, lreg(IX));
-			break;
-		case 0x7E:			/* LD A,(IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			Sethreg(AF, GetBYTE(adr));
-			break;
-		case 0x84:			/* ADD A,IXH */
-			temp = hreg(IX);
-			acu = hreg(AF);
-			sum = acu + temp;
-			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				((cbits >> 8) & 1);
-			break;
-		case 0x85:			/* ADD A,IXL */
-			temp = lreg(IX);
-			acu = hreg(AF);
-			sum = acu + temp;
-			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				((cbits >> 8) & 1);
-			break;
-		case 0x86:			/* ADD A,(IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			temp = GetBYTE(adr);
-			acu = hreg(AF);
-			sum = acu + temp;
-			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				((cbits >> 8) & 1);
-			break;
-		case 0x8C:			/* ADC A,IXH */
-			temp = hreg(IX);
-			acu = hreg(AF);
-			sum = acu + temp + TSTFLAG(C);
-			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				((cbits >> 8) & 1);
-			break;
-		case 0x8D:			/* ADC A,IXL */
-			temp = lreg(IX);
-			acu = hreg(AF);
-			sum = acu + temp + TSTFLAG(C);
-			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				((cbits >> 8) & 1);
-			break;
-		case 0x8E:			/* ADC A,(IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			temp = GetBYTE(adr);
-			acu = hreg(AF);
-			sum = acu + temp + TSTFLAG(C);
-			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				((cbits >> 8) & 1);
-			break;
-		case 0x94:			/* SUB IXH */
-			temp = hreg(IX);
-			acu = hreg(AF);
-			sum = acu - temp;
-			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				((cbits >> 8) & 1);
-			break;
-		case 0x95:			/* SUB IXL */
-			temp = lreg(IX);
-			acu = hreg(AF);
-			sum = acu - temp;
-			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				((cbits >> 8) & 1);
-			break;
-		case 0x96:			/* SUB (IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			temp = GetBYTE(adr);
-			acu = hreg(AF);
-			sum = acu - temp;
-			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				((cbits >> 8) & 1);
-			break;
-		case 0x9C:			/* SBC A,IXH */
-			temp = hreg(IX);
-			acu = hreg(AF);
-			sum = acu - temp - TSTFLAG(C);
-			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				((cbits >> 8) & 1);
-			break;
-		case 0x9D:			/* SBC A,IXL */
-			temp = lreg(IX);
-			acu = hreg(AF);
-			sum = acu - temp - TSTFLAG(C);
-			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				((cbits >> 8) & 1);
-			break;
-		case 0x9E:			/* SBC A,(IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			temp = GetBYTE(adr);
-			acu = hreg(AF);
-			sum = acu - temp - TSTFLAG(C);
-			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				((cbits >> 8) & 1);
-			break;
-		case 0xA4:			/* AND IXH */
-			sum = ((AF & (IX)) >> 8) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) |
-				((sum == 0) << 6) | 0x10 | partab[sum];
-			break;
-		case 0xA5:			/* AND IXL */
-			sum = ((AF >> 8) & IX) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-				((sum == 0) << 6) | partab[sum];
-			break;
-		case 0xA6:			/* AND (IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			sum = ((AF >> 8) & GetBYTE(adr)) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-				((sum == 0) << 6) | partab[sum];
-			break;
-		case 0xAC:			/* XOR IXH */
-			sum = ((AF ^ (IX)) >> 8) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-			break;
-		case 0xAD:			/* XOR IXL */
-			sum = ((AF >> 8) ^ IX) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-			break;
-		case 0xAE:			/* XOR (IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			sum = ((AF >> 8) ^ GetBYTE(adr)) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-			break;
-		case 0xB4:			/* OR IXH */
-			sum = ((AF | (IX)) >> 8) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-			break;
-		case 0xB5:			/* OR IXL */
-			sum = ((AF >> 8) | IX) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-			break;
-		case 0xB6:			/* OR (IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			sum = ((AF >> 8) | GetBYTE(adr)) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-			break;
-		case 0xBC:			/* CP IXH */
-			temp = hreg(IX);
-			AF = (AF & ~0x28) | (temp & 0x28);
-			acu = hreg(AF);
-			sum = acu - temp;
-			cbits = acu ^ temp ^ sum;
-			AF = (AF & ~0xff) | (sum & 0x80) |
-				(((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				(cbits & 0x10) | ((cbits >> 8) & 1);
-			break;
-		case 0xBD:			/* CP IXL */
-			temp = lreg(IX);
-			AF = (AF & ~0x28) | (temp & 0x28);
-			acu = hreg(AF);
-			sum = acu - temp;
-			cbits = acu ^ temp ^ sum;
-			AF = (AF & ~0xff) | (sum & 0x80) |
-				(((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				(cbits & 0x10) | ((cbits >> 8) & 1);
-			break;
-		case 0xBE:			/* CP (IX+dd) */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			temp = GetBYTE(adr);
-			AF = (AF & ~0x28) | (temp & 0x28);
-			acu = hreg(AF);
-			sum = acu - temp;
-			cbits = acu ^ temp ^ sum;
-			AF = (AF & ~0xff) | (sum & 0x80) |
-				(((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				(cbits & 0x10) | ((cbits >> 8) & 1);
-			break;
-		case 0xCB:			/* CB prefix */
-			adr = IX + (signed char) GetBYTE_pp(PC);
-			adr = adr;
-			switch ((op = GetBYTE(PC)) & 7) {
-			case 0: ++PC; acu = hreg(BC); break;
-			case 1: ++PC; acu = lreg(BC); break;
-			case 2: ++PC; acu = hreg(DE); break;
-			case 3: ++PC; acu = lreg(DE); break;
-			case 4: ++PC; acu = hreg(HL); break;
-			case 5: ++PC; acu = lreg(HL); break;
-			case 6: ++PC; acu = GetBYTE(adr);  break;
-			case 7: ++PC; acu = hreg(AF); break;
-			}
-			switch (op & 0xc0) {
-			case 0x00:		/* shift/rotate */
-				switch (op & 0x38) {
-				case 0x00:	/* RLC */
-					temp = (acu << 1) | (acu >> 7);
-					cbits = temp & 1;
-					goto cbshflg2;
-				case 0x08:	/* RRC */
-					temp = (acu >> 1) | (acu << 7);
-					cbits = temp & 0x80;
-					goto cbshflg2;
-				case 0x10:	/* RL */
-					temp = (acu << 1) | TSTFLAG(C);
-					cbits = acu & 0x80;
-					goto cbshflg2;
-				case 0x18:	/* RR */
-					temp = (acu >> 1) | (TSTFLAG(C) << 7);
-					cbits = acu & 1;
-					goto cbshflg2;
-				case 0x20:	/* SLA */
-					temp = acu << 1;
-					cbits = acu & 0x80;
-					goto cbshflg2;
-				case 0x28:	/* SRA */
-					temp = (acu >> 1) | (acu & 0x80);
-					cbits = acu & 1;
-					goto cbshflg2;
-				case 0x30:	/* SLIA */
-					temp = (acu << 1) | 1;
-					cbits = acu & 0x80;
-					goto cbshflg2;
-				case 0x38:	/* SRL */
-					temp = acu >> 1;
-					cbits = acu & 1;
-				cbshflg2:
-					AF = (AF & ~0xff) | (temp & 0xa8) |
-						(((temp & 0xff) == 0) << 6) |
-						parity(temp) | !!cbits;
-				}
-				break;
-			case 0x40:		/* BIT */
-				if (acu & (1 << ((op >> 3) & 7)))
-					AF = (AF & ~0xfe) | 0x10 |
-					(((op & 0x38) == 0x38) << 7);
-				else
-					AF = (AF & ~0xfe) | 0x54;
-				if ((op&7) != 6)
-					AF |= (acu & 0x28);
-				temp = acu;
-				break;
-			case 0x80:		/* RES */
-				temp = acu & ~(1 << ((op >> 3) & 7));
-				break;
-			case 0xc0:		/* SET */
-				temp = acu | (1 << ((op >> 3) & 7));
-				break;
-			}
-			switch (op & 7) {
-			case 0: Sethreg(BC, temp); break;
-			case 1: Setlreg(BC, temp); break;
-			case 2: Sethreg(DE, temp); break;
-			case 3: Setlreg(DE, temp); break;
-			case 4: Sethreg(HL, temp); break;
-			case 5: Setlreg(HL, temp); break;
-			case 6: PutBYTE(adr, temp);  break;
-			case 7: Sethreg(AF, temp); break;
+		sum = acu - temp;
+		cbits = acu ^ temp ^ sum;
+		AF = (AF & ~0xff) | (sztab[sum & 0xff] & 0xc0) | (temp & 0x28) |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0xBB):			/* CP E */
+		temp = lreg(DE);
+		AF = (AF & ~0x28) | (temp & 0x28);
+		acu = hreg(AF);
+		sum = acu - temp;
+		cbits = acu ^ temp ^ sum;
+		AF = (AF & ~0xff) | (sztab[sum & 0xff] & 0xc0) | (temp & 0x28) |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0xBC):			/* CP H */
+		temp = hreg(HL);
+		AF = (AF & ~0x28) | (temp & 0x28);
+		acu = hreg(AF);
+		sum = acu - temp;
+		cbits = acu ^ temp ^ sum;
+		AF = (AF & ~0xff) | (sztab[sum & 0xff] & 0xc0) | (temp & 0x28) |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0xBD):			/* CP L */
+		temp = lreg(HL);
+		AF = (AF & ~0x28) | (temp & 0x28);
+		acu = hreg(AF);
+		sum = acu - temp;
+		cbits = acu ^ temp ^ sum;
+		AF = (AF & ~0xff) | (sztab[sum & 0xff] & 0xc0) | (temp & 0x28) |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0xBE):			/* CP (HL) */
+		temp = GetBYTE(HL);
+		AF = (AF & ~0x28) | (temp & 0x28);
+		acu = hreg(AF);
+		sum = acu - temp;
+		cbits = acu ^ temp ^ sum;
+		AF = (AF & ~0xff) | (sztab[sum & 0xff] & 0xc0) | (temp & 0x28) |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0xBF):			/* CP A */
+		temp = hreg(AF);
+		AF = (AF & ~0x28) | (temp & 0x28);
+		acu = hreg(AF);
+		sum = acu - temp;
+		cbits = acu ^ temp ^ sum;
+		AF = (AF & ~0xff) | (sztab[sum & 0xff] & 0xc0) | (temp & 0x28) |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0xC0):			/* RET NZ */
+		TAKEN(!TSTFLAG(Z), 6);
+		if (!TSTFLAG(Z)) POP(PC);
+		goto branched;
+	CASE(0xC1):			/* POP BC */
+		POP(BC);
+		NEXT;
+	CASE(0xC2):			/* JP NZ,nnnn */
+		JPC(!TSTFLAG(Z));
+		goto branched;
+	CASE(0xC3):			/* JP nnnn */
+		JPC(1);
+		goto branched;
+	CASE(0xC4):			/* CALL NZ,nnnn */
+		CALLC(!TSTFLAG(Z));
+		goto branched;
+	CASE(0xC5):			/* PUSH BC */
+		PUSH(BC);
+		NEXT;
+	CASE(0xC6):			/* ADD A,nn */
+		temp = GetBYTE_pp(PC);
+		acu = hreg(AF);
+		sum = acu + temp;
+		cbits = acu ^ temp ^ sum;
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0xC7):			/* RST 0 */
+		PUSH(PC); PC = 0;
+		PROFILE_CALL();
+		goto branched;
+	CASE(0xC8):			/* RET Z */
+		TAKEN(TSTFLAG(Z), 6);
+		if (TSTFLAG(Z)) POP(PC);
+		goto branched;
+	CASE(0xC9):			/* RET */
+		POP(PC);
+		goto branched;
+	CASE(0xCA):			/* JP Z,nnnn */
+		JPC(TSTFLAG(Z));
+		goto branched;
+	CASE(0xCB):			/* CB prefix */
+		adr = HL;
+		PROFILE_OP(OPS_CB, tcb, RAM(PC));
+	cbprefix:			/* DDCB and FDCB too, adr is (XY+dd) */
+#ifdef THREADED
+		goto *cbtab[GetBYTE_pp(PC)];
+#endif
+		switch ((op = GetBYTE_pp(PC)) & 7) {
+		case 0: acu = hreg(BC); break;
+		case 1: acu = lreg(BC); break;
+		case 2: acu = hreg(DE); break;
+		case 3: acu = lreg(DE); break;
+		case 4: acu = hreg(HL); break;
+		case 5: acu = lreg(HL); break;
+		case 6: acu = GetBYTE(adr);  break;
+		case 7: acu = hreg(AF); break;
+		}
+		switch (op & 0xc0) {
+		case 0x00:		/* shift/rotate */
+			switch (op & 0x38) {
+			case 0x00:	/* RLC */
+				temp = (acu << 1) | (acu >> 7);
+				cbits = temp & 1;
+				goto cbshflg1;
+			case 0x08:	/* RRC */
+				temp = (acu >> 1) | (acu << 7);
+				cbits = temp & 0x80;
+				goto cbshflg1;
+			case 0x10:	/* RL */
+				temp = (acu << 1) | TSTFLAG(C);
+				cbits = acu & 0x80;
+				goto cbshflg1;
+			case 0x18:	/* RR */
+				temp = (acu >> 1) | (TSTFLAG(C) << 7);
+				cbits = acu & 1;
+				goto cbshflg1;
+			case 0x20:	/* SLA */
+				temp = acu << 1;
+				cbits = acu & 0x80;
+				goto cbshflg1;
+			case 0x28:	/* SRA */
+				temp = (acu >> 1) | (acu & 0x80);
+				cbits = acu & 1;
+				goto cbshflg1;
+			case 0x30:	/* SLIA */
+				temp = (acu << 1) | 1;
+				cbits = acu & 0x80;
+				goto cbshflg1;
+			case 0x38:	/* SRL */
+				temp = acu >> 1;
+				cbits = acu & 1;
+			cbshflg1:
+				AF = (AF & ~0xff) | szptab[temp & 0xff] | !!cbits;
 			}
 			break;
-		case 0xE1:			/* POP IX */
-			POP(IX);
-			break;
-		case 0xE3:			/* EX (SP),IX */
-			temp = IX; POP(IX); PUSH(temp);
-			break;
-		case 0xE5:			/* PUSH IX */
-			PUSH(IX);
+		case 0x40:		/* BIT */
+			if (acu & (1 << ((op >> 3) & 7)))
+				AF = (AF & ~0xfe) | 0x10 |
+				(((op & 0x38) == 0x38) << 7);
+			else
+				AF = (AF & ~0xfe) | 0x54;
+			if ((op&7) != 6)
+				AF |= (acu & 0x28);
+			temp = acu;
 			break;
-		case 0xE9:			/* JP (IX) */
-			PC = IX;
+		case 0x80:		/* RES */
+			temp = acu & ~(1 << ((op >> 3) & 7));
 			break;
-		case 0xF9:			/* LD SP,IX */
-			SP = IX;
+		case 0xc0:		/* SET */
+			temp = acu | (1 << ((op >> 3) & 7));
 			break;
-		default: PC--;		/* ignore DD */
 		}
-		break;
-	case 0xDE:			/* SBC A,nn */
+		switch (op & 7) {
+		case 0: Sethreg(BC, temp); break;
+		case 1: Setlreg(BC, temp); break;
+		case 2: Sethreg(DE, temp); break;
+		case 3: Setlreg(DE, temp); break;
+		case 4: Sethreg(HL, temp); break;
+		case 5: Setlreg(HL, temp); break;
+		case 6: PutBYTE(adr, temp);  break;
+		case 7: Sethreg(AF, temp); break;
+		}
+		NEXT;
+	CASE(0xCC):			/* CALL Z,nnnn */
+		CALLC(TSTFLAG(Z));
+		goto branched;
+	CASE(0xCD):			/* CALL nnnn */
+		CALLC(1);
+		goto branched;
+	CASE(0xCE):			/* ADC A,nn */
+		temp = GetBYTE_pp(PC);
+		acu = hreg(AF);
+		sum = acu + temp + TSTFLAG(C);
+		cbits = acu ^ temp ^ sum;
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
+		NEXT;
+	CASE(0xCF):			/* RST 8 */
+		PUSH(PC); PC = 8;
+		PROFILE_CALL();
+		goto branched;
+	CASE(0xD0):			/* RET NC */
+		TAKEN(!TSTFLAG(C), 6);
+		if (!TSTFLAG(C)) POP(PC);
+		goto branched;
+	CASE(0xD1):			/* POP DE */
+		POP(DE);
+		NEXT;
+	CASE(0xD2):			/* JP NC,nnnn */
+		JPC(!TSTFLAG(C));
+		goto branched;
+	CASE(0xD3):			/* OUT (nn),A */
+		Output(GetBYTE_pp(PC), hreg(AF));
+		NEXT;
+	CASE(0xD4):			/* CALL NC,nnnn */
+		CALLC(!TSTFLAG(C));
+		goto branched;
+	CASE(0xD5):			/* PUSH DE */
+		PUSH(DE);
+		NEXT;
+	CASE(0xD6):			/* SUB nn */
+		temp = GetBYTE_pp(PC);
+		acu = hreg(AF);
+		sum = acu - temp;
+		cbits = acu ^ temp ^ sum;
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0xD7):			/* RST 10H */
+		PUSH(PC); PC = 0x10;
+		PROFILE_CALL();
+		goto branched;
+	CASE(0xD8):			/* RET C */
+		TAKEN(TSTFLAG(C), 6);
+		if (TSTFLAG(C)) POP(PC);
+		goto branched;
+	CASE(0xD9):			/* EXX */
+		m->regs[m->regs_sel].bc = BC;
+		m->regs[m->regs_sel].de = DE;
+		m->regs[m->regs_sel].hl = HL;
+		m->regs_sel = 1 - m->regs_sel;
+		BC = m->regs[m->regs_sel].bc;
+		DE = m->regs[m->regs_sel].de;
+		HL = m->regs[m->regs_sel].hl;
+		NEXT;
+	CASE(0xDA):			/* JP C,nnnn */
+		JPC(TSTFLAG(C));
+		goto branched;
+	CASE(0xDB):			/* IN A,(nn) */
+		Sethreg(AF, Input(GetBYTE_pp(PC)));
+		NEXT;
+	CASE(0xDC):			/* CALL C,nnnn */
+		CALLC(TSTFLAG(C));
+		goto branched;
+	CASE(0xDD):			/* DD prefix */
+		XY = IX;
+		op = 0xdd;
+		goto indexed;
+	CASE(0xDE):			/* SBC A,nn */
 		temp = GetBYTE_pp(PC);
 		acu = hreg(AF);
 		sum = acu - temp - TSTFLAG(C);
 		cbits = acu ^ temp ^ sum;
-		AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-			(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			((cbits >> 8) & 1);
-		break;
-	case 0xDF:			/* RST 18H */
+		AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0xDF):			/* RST 18H */
 		PUSH(PC); PC = 0x18;
-		break;
-	case 0xE0:			/* RET PO */
+		PROFILE_CALL();
+		goto branched;
+	CASE(0xE0):			/* RET PO */
+		TAKEN(!TSTFLAG(P), 6);
 		if (!TSTFLAG(P)) POP(PC);
-		break;
-	case 0xE1:			/* POP HL */
+		goto branched;
+	CASE(0xE1):			/* POP HL */
 		POP(HL);
-		break;
-	case 0xE2:			/* JP PO,nnnn */
+		NEXT;
+	CASE(0xE2):			/* JP PO,nnnn */
 		JPC(!TSTFLAG(P));
-		break;
-	case 0xE3:			/* EX (SP),HL */
+		goto branched;
+	CASE(0xE3):			/* EX (SP),HL */
 		temp = HL; POP(HL); PUSH(temp);
-		break;
-	case 0xE4:			/* CALL PO,nnnn */
+		NEXT;
+	CASE(0xE4):			/* CALL PO,nnnn */
 		CALLC(!TSTFLAG(P));
-		break;
-	case 0xE5:			/* PUSH HL */
+		goto branched;
+	CASE(0xE5):			/* PUSH HL */
 		PUSH(HL);
-		break;
-	case 0xE6:			/* AND nn */
+		NEXT;
+	CASE(0xE6):			/* AND nn */
 		sum = ((AF >> 8) & GetBYTE_pp(PC)) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-			((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xE7:			/* RST 20H */
+		AF = (sum << 8) | szptab[sum] | 0x10;
+		NEXT;
+	CASE(0xE7):			/* RST 20H */
 		PUSH(PC); PC = 0x20;
-		break;
-	case 0xE8:			/* RET PE */
+		PROFILE_CALL();
+		goto branched;
+	CASE(0xE8):			/* RET PE */
+		TAKEN(TSTFLAG(P), 6);
 		if (TSTFLAG(P)) POP(PC);
-		break;
-	case 0xE9:			/* JP (HL) */
+		goto branched;
+	CASE(0xE9):			/* JP (HL) */
 		PC = HL;
-		break;
-	case 0xEA:			/* JP PE,nnnn */
+		goto branched;
+	CASE(0xEA):			/* JP PE,nnnn */
 		JPC(TSTFLAG(P));
-		break;
-	case 0xEB:			/* EX DE,HL */
+		goto branched;
+	CASE(0xEB):			/* EX DE,HL */
 		temp = HL; HL = DE; DE = temp;
-		break;
-	case 0xEC:			/* CALL PE,nnnn */
+		NEXT;
+	CASE(0xEC):			/* CALL PE,nnnn */
 		CALLC(TSTFLAG(P));
-		break;
-	case 0xED:			/* ED prefix */
+		goto branched;
+	CASE(0xED):			/* ED prefix */
+		PROFILE_OP(OPS_ED, ted, RAM(PC));
+#ifdef THREADED
+		goto *edtab[op = GetBYTE_pp(PC)];
+#endif
 		switch (op = GetBYTE_pp(PC)) {
-		case 0x40:			/* IN B,(C) */
+		EDCASE(0x40):			/* IN B,(C) */
 			temp = Input(lreg(BC));
 			Sethreg(BC, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				parity(temp);
+			AF = (AF & ~0xfe) | szptab[temp & 0xff];
 			break;
-		case 0x41:			/* OUT (C),B */
+		EDCASE(0x41):			/* OUT (C),B */
 			Output(lreg(BC), BC);
 			break;
-		case 0x42:			/* SBC HL,BC */
+		EDCASE(0x42):			/* SBC HL,BC */
 			HL &= 0xffff;
 			BC &= 0xffff;
 			sum = HL - BC - TSTFLAG(C);
 			cbits = (HL ^ BC ^ sum) >> 8;
 			HL = sum;
 			AF = (AF & ~0xff) | ((sum >> 8) & 0xa8) |
-				(((sum & 0xffff) == 0) << 6) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				(cbits & 0x10) | 2 | ((cbits >> 8) & 1);
+				(((sum & 0xffff) == 0) << 6) | cbitstab[cbits & 0x1ff] | 2;
 			break;
-		case 0x43:			/* LD (nnnn),BC */
+		EDCASE(0x43):			/* LD (nnnn),BC */
 			temp = GetWORD(PC);
 			PutWORD(temp, BC);
 			PC += 2;
 			break;
-		case 0x44:			/* NEG */
+		EDCASE(0x44):			/* NEG */
 			temp = hreg(AF);
 			AF = (-(AF & 0xff00) & 0xff00);
 			AF |= ((AF >> 8) & 0xa8) | (((AF & 0xff00) == 0) << 6) |
 				(((temp & 0x0f) != 0) << 4) | ((temp == 0x80) << 2) |
 				2 | (temp != 0);
 			break;
-		case 0x45:			/* RETN */
-			IFF |= IFF >> 1;
+		EDCASE(0x45):			/* RETN */
+			m->IFF |= m->IFF >> 1;
 			POP(PC);
-			break;
-		case 0x46:			/* IM 0 */
+			goto branched;
+		EDCASE(0x46):			/* IM 0 */
 			/* interrupt mode 0 */
 			break;
-		case 0x47:			/* LD I,A */
-			ir = (ir & 255) | (AF & ~255);
+		EDCASE(0x47):			/* LD I,A */
+			m->ir = (m->ir & 255) | (AF & ~255);
 			break;
-		case 0x48:			/* IN C,(C) */
+		EDCASE(0x48):			/* IN C,(C) */
 			temp = Input(lreg(BC));
 			Setlreg(BC, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				parity(temp);
+			AF = (AF & ~0xfe) | szptab[temp & 0xff];
 			break;
-		case 0x49:			/* OUT (C),C */
+		EDCASE(0x49):			/* OUT (C),C */
 			Output(lreg(BC), BC);
 			break;
-		case 0x4A:			/* ADC HL,BC */
+		EDCASE(0x4A):			/* ADC HL,BC */
 			HL &= 0xffff;
 			BC &= 0xffff;
 			sum = HL + BC + TSTFLAG(C);
 			cbits = (HL ^ BC ^ sum) >> 8;
 			HL = sum;
 			AF = (AF & ~0xff) | ((sum >> 8) & 0xa8) |
-				(((sum & 0xffff) == 0) << 6) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				(cbits & 0x10) | ((cbits >> 8) & 1);
+				(((sum & 0xffff) == 0) << 6) | cbitstab[cbits & 0x1ff];
 			break;
-		case 0x4B:			/* LD BC,(nnnn) */
+		EDCASE(0x4B):			/* LD BC,(nnnn) */
 			temp = GetWORD(PC);
 			BC = GetWORD(temp);
 			PC += 2;
 			break;
-		case 0x4D:			/* RETI */
-			IFF |= IFF >> 1;
+		EDCASE(0x4D):			/* RETI */
+			m->IFF |= m->IFF >> 1;
 			POP(PC);
+			goto branched;
+		EDCASE(0x4F):			/* LD R,A */
+			m->ir = (m->ir & ~255) | ((AF >> 8) & 255);
 			break;
-		case 0x4F:			/* LD R,A */
-			ir = (ir & ~255) | ((AF >> 8) & 255);
-			break;
-		case 0x50:			/* IN D,(C) */
+		EDCASE(0x50):			/* IN D,(C) */
 			temp = Input(lreg(BC));
 			Sethreg(DE, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				parity(temp);
+			AF = (AF & ~0xfe) | szptab[temp & 0xff];
 			break;
-		case 0x51:			/* OUT (C),D */
+		EDCASE(0x51):			/* OUT (C),D */
 			Output(lreg(BC), DE);
 			break;
-		case 0x52:			/* SBC HL,DE */
+		EDCASE(0x52):			/* SBC HL,DE */
 			HL &= 0xffff;
 			DE &= 0xffff;
 			sum = HL - DE - TSTFLAG(C);
 			cbits = (HL ^ DE ^ sum) >> 8;
 			HL = sum;
 			AF = (AF & ~0xff) | ((sum >> 8) & 0xa8) |
-				(((sum & 0xffff) == 0) << 6) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				(cbits & 0x10) | 2 | ((cbits >> 8) & 1);
+				(((sum & 0xffff) == 0) << 6) | cbitstab[cbits & 0x1ff] | 2;
 			break;
-		case 0x53:			/* LD (nnnn),DE */
+		EDCASE(0x53):			/* LD (nnnn),DE */
 			temp = GetWORD(PC);
 			PutWORD(temp, DE);
 			PC += 2;
 			break;
-		case 0x56:			/* IM 1 */
+		EDCASE(0x56):			/* IM 1 */
 			/* interrupt mode 1 */
 			break;
-		case 0x57:			/* LD A,I */
-			AF = (AF & 0x29) | (ir & ~255) | ((ir >> 8) & 0x80) | (((ir & ~255) == 0) << 6) | ((IFF & 2) << 1);
+		EDCASE(0x57):			/* LD A,I */
+			AF = (AF & 0x29) | (m->ir & ~255) | ((m->ir >> 8) & 0x80) | (((m->ir & ~255) == 0) << 6) | ((m->IFF & 2) << 1);
 			break;
-		case 0x58:			/* IN E,(C) */
+		EDCASE(0x58):			/* IN E,(C) */
 			temp = Input(lreg(BC));
 			Setlreg(DE, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				parity(temp);
+			AF = (AF & ~0xfe) | szptab[temp & 0xff];
 			break;
-		case 0x59:			/* OUT (C),E */
+		EDCASE(0x59):			/* OUT (C),E */
 			Output(lreg(BC), DE);
 			break;
-		case 0x5A:			/* ADC HL,DE */
+		EDCASE(0x5A):			/* ADC HL,DE */
 			HL &= 0xffff;
 			DE &= 0xffff;
 			sum = HL + DE + TSTFLAG(C);
 			cbits = (HL ^ DE ^ sum) >> 8;
 			HL = sum;
 			AF = (AF & ~0xff) | ((sum >> 8) & 0xa8) |
-				(((sum & 0xffff) == 0) << 6) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				(cbits & 0x10) | ((cbits >> 8) & 1);
+				(((sum & 0xffff) == 0) << 6) | cbitstab[cbits & 0x1ff];
 			break;
-		case 0x5B:			/* LD DE,(nnnn) */
+		EDCASE(0x5B):			/* LD DE,(nnnn) */
 			temp = GetWORD(PC);
 			DE = GetWORD(temp);
 			PC += 2;
 			break;
-		case 0x5E:			/* IM 2 */
+		EDCASE(0x5E):			/* IM 2 */
 			/* interrupt mode 2 */
 			break;
-		case 0x5F:			/* LD A,R */
-			AF = (AF & 0x29) | ((ir & 255) << 8) | (ir & 0x80) | (((ir & 255) == 0) << 6) | ((IFF & 2) << 1);
+		EDCASE(0x5F):			/* LD A,R */
+			AF = (AF & 0x29) | ((m->ir & 255) << 8) | (m->ir & 0x80) | (((m->ir & 255) == 0) << 6) | ((m->IFF & 2) << 1);
 			break;
-		case 0x60:			/* IN H,(C) */
+		EDCASE(0x60):			/* IN H,(C) */
 			temp = Input(lreg(BC));
 			Sethreg(HL, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				parity(temp);
+			AF = (AF & ~0xfe) | szptab[temp & 0xff];
 			break;
-		case 0x61:			/* OUT (C),H */
+		EDCASE(0x61):			/* OUT (C),H */
 			Output(lreg(BC), HL);
 			break;
-		case 0x62:			/* SBC HL,HL */
+		EDCASE(0x62):			/* SBC HL,HL */
 			HL &= 0xffff;
 			sum = HL - HL - TSTFLAG(C);
 			cbits = (HL ^ HL ^ sum) >> 8;
 			HL = sum;
 			AF = (AF & ~0xff) | ((sum >> 8) & 0xa8) |
-				(((sum & 0xffff) == 0) << 6) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				(cbits & 0x10) | 2 | ((cbits >> 8) & 1);
+				(((sum & 0xffff) == 0) << 6) | cbitstab[cbits & 0x1ff] | 2;
 			break;
-		case 0x63:			/* LD (nnnn),HL */
+		EDCASE(0x63):			/* LD (nnnn),HL */
 			temp = GetWORD(PC);
 			PutWORD(temp, HL);
 			PC += 2;
 			break;
-		case 0x67:			/* RRD */
+		EDCASE(0x67):			/* RRD */
 			temp = GetBYTE(HL);
 			acu = hreg(AF);
 			PutBYTE(HL, hdig(temp) | (ldig(acu) << 4));
 			acu = (acu & 0xf0) | ldig(temp);
-			AF = (acu << 8) | (acu & 0xa8) | (((acu & 0xff) == 0) << 6) |
-				partab[acu] | (AF & 1);
+			AF = (acu << 8) | szptab[acu] | (AF & 1);
 			break;
-		case 0x68:			/* IN L,(C) */
+		EDCASE(0x68):			/* IN L,(C) */
 			temp = Input(lreg(BC));
 			Setlreg(HL, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				parity(temp);
+			AF = (AF & ~0xfe) | szptab[temp & 0xff];
 			break;
-		case 0x69:			/* OUT (C),L */
+		EDCASE(0x69):			/* OUT (C),L */
 			Output(lreg(BC), HL);
 			break;
-		case 0x6A:			/* ADC HL,HL */
+		EDCASE(0x6A):			/* ADC HL,HL */
 			HL &= 0xffff;
 			sum = HL + HL + TSTFLAG(C);
 			cbits = (HL ^ HL ^ sum) >> 8;
 			HL = sum;
 			AF = (AF & ~0xff) | ((sum >> 8) & 0xa8) |
-				(((sum & 0xffff) == 0) << 6) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				(cbits & 0x10) | ((cbits >> 8) & 1);
+				(((sum & 0xffff) == 0) << 6) | cbitstab[cbits & 0x1ff];
 			break;
-		case 0x6B:			/* LD HL,(nnnn) */
+		EDCASE(0x6B):			/* LD HL,(nnnn) */
 			temp = GetWORD(PC);
 			HL = GetWORD(temp);
 			PC += 2;
 			break;
-		case 0x6F:			/* RLD */
+		EDCASE(0x6F):			/* RLD */
 			temp = GetBYTE(HL);
 			acu = hreg(AF);
 			PutBYTE(HL, (ldig(temp) << 4) | ldig(acu));
 			acu = (acu & 0xf0) | hdig(temp);
-			AF = (acu << 8) | (acu & 0xa8) | (((acu & 0xff) == 0) << 6) |
-				partab[acu] | (AF & 1);
+			AF = (acu << 8) | szptab[acu] | (AF & 1);
 			break;
-		case 0x70:			/* IN (C) */
+		EDCASE(0x70):			/* IN (C) */
 			temp = Input(lreg(BC));
 			Setlreg(temp, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				parity(temp);
+			AF = (AF & ~0xfe) | szptab[temp & 0xff];
 			break;
-		case 0x71:			/* OUT (C),0 */
+		EDCASE(0x71):			/* OUT (C),0 */
 			Output(lreg(BC), 0);
 			break;
-		case 0x72:			/* SBC HL,SP */
+		EDCASE(0x72):			/* SBC HL,SP */
 			HL &= 0xffff;
 			SP &= 0xffff;
 			sum = HL - SP - TSTFLAG(C);
 			cbits = (HL ^ SP ^ sum) >> 8;
 			HL = sum;
 			AF = (AF & ~0xff) | ((sum >> 8) & 0xa8) |
-				(((sum & 0xffff) == 0) << 6) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				(cbits & 0x10) | 2 | ((cbits >> 8) & 1);
+				(((sum & 0xffff) == 0) << 6) | cbitstab[cbits & 0x1ff] | 2;
 			break;
-		case 0x73:			/* LD (nnnn),SP */
+		EDCASE(0x73):			/* LD (nnnn),SP */
 			temp = GetWORD(PC);
 			PutWORD(temp, SP);
 			PC += 2;
 			break;
-		case 0x78:			/* IN A,(C) */
+		EDCASE(0x78):			/* IN A,(C) */
 			temp = Input(lreg(BC));
 			Sethreg(AF, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				parity(temp);
+			AF = (AF & ~0xfe) | szptab[temp & 0xff];
 			break;
-		case 0x79:			/* OUT (C),A */
+		EDCASE(0x79):			/* OUT (C),A */
 			Output(lreg(BC), AF);
 			break;
-		case 0x7A:			/* ADC HL,SP */
+		EDCASE(0x7A):			/* ADC HL,SP */
 			HL &= 0xffff;
 			SP &= 0xffff;
 			sum = HL + SP + TSTFLAG(C);
 			cbits = (HL ^ SP ^ sum) >> 8;
 			HL = sum;
 			AF = (AF & ~0xff) | ((sum >> 8) & 0xa8) |
-				(((sum & 0xffff) == 0) << 6) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				(cbits & 0x10) | ((cbits >> 8) & 1);
+				(((sum & 0xffff) == 0) << 6) | cbitstab[cbits & 0x1ff];
 			break;
-		case 0x7B:			/* LD SP,(nnnn) */
+		EDCASE(0x7B):			/* LD SP,(nnnn) */
 			temp = GetWORD(PC);
 			SP = GetWORD(temp);
 			PC += 2;
 			break;
-		case 0xA0:			/* LDI */
+		EDCASE(0xA0):			/* LDI */
 			acu = GetBYTE_pp(HL);
 			PutBYTE_pp(DE, acu);
 			acu += hreg(AF);
 			AF = (AF & ~0x3e) | (acu & 8) | ((acu & 2) << 4) |
 				(((--BC & 0xffff) != 0) << 2);
 			break;
-		case 0xA1:			/* CPI */
+		EDCASE(0xA1):			/* CPI */
 			acu = hreg(AF);
 			temp = GetBYTE_pp(HL);
 			sum = acu - temp;
@@ -2242,25 +2126,25 @@ simz80(FASTREG PC)
 			if ((sum & 15) == 8 && (cbits & 16) != 0)
 				AF &= ~8;
 			break;
-		case 0xA2:			/* INI */
+		EDCASE(0xA2):			/* INI */
 			PutBYTE(HL, Input(lreg(BC))); ++HL;
 			SETFLAG(N, 1);
 			SETFLAG(P, (--BC & 0xffff) != 0);
 			break;
-		case 0xA3:			/* OUTI */
+		EDCASE(0xA3):			/* OUTI */
 			Output(lreg(BC), GetBYTE(HL)); ++HL;
 			SETFLAG(N, 1);
 			Sethreg(BC, hreg(BC) - 1);
 			SETFLAG(Z, hreg(BC) == 0);
 			break;
-		case 0xA8:			/* LDD */
+		EDCASE(0xA8):			/* LDD */
 			acu = GetBYTE_mm(HL);
 			PutBYTE_mm(DE, acu);
 			acu += hreg(AF);
 			AF = (AF & ~0x3e) | (acu & 8) | ((acu & 2) << 4) |
 				(((--BC & 0xffff) != 0) << 2);
 			break;
-		case 0xA9:			/* CPD */
+		EDCASE(0xA9):			/* CPD */
 			acu = hreg(AF);
 			temp = GetBYTE_mm(HL);
 			sum = acu - temp;
@@ -2272,35 +2156,37 @@ simz80(FASTREG PC)
 			if ((sum & 15) == 8 && (cbits & 16) != 0)
 				AF &= ~8;
 			break;
-		case 0xAA:			/* IND */
+		EDCASE(0xAA):			/* IND */
 			PutBYTE(HL, Input(lreg(BC))); --HL;
 			SETFLAG(N, 1);
 			Sethreg(BC, lreg(BC) - 1);
 			SETFLAG(Z, lreg(BC) == 0);
 			break;
-		case 0xAB:			/* OUTD */
+		EDCASE(0xAB):			/* OUTD */
 			Output(lreg(BC), GetBYTE(HL)); --HL;
 			SETFLAG(N, 1);
 			Sethreg(BC, hreg(BC) - 1);
 			SETFLAG(Z, hreg(BC) == 0);
 			break;
-		case 0xB0:			/* LDIR */
+		EDCASE(0xB0):			/* LDIR, 65536 times when BC = 0 */
 			acu = hreg(AF);
 			BC &= 0xffff;
+			TSTATES(21 * ((BC - 1) & 0xffff));
 			do {
 				acu = GetBYTE_pp(HL);
 				PutBYTE_pp(DE, acu);
-			} while (--BC);
+			} while ((BC = (BC - 1) & 0xffff) != 0);
 			acu += hreg(AF);
 			AF = (AF & ~0x3e) | (acu & 8) | ((acu & 2) << 4);
 			break;
-		case 0xB1:			/* CPIR */
+		EDCASE(0xB1):			/* CPIR */
 			acu = hreg(AF);
 			BC &= 0xffff;
 			do {
 				temp = GetBYTE_pp(HL);
-				op = --BC != 0;
+				op = (BC = (BC - 1) & 0xffff) != 0;
 				sum = acu - temp;
+				TAKEN(op && sum != 0, 21);
 			} while (op && sum != 0);
 			cbits = acu ^ temp ^ sum;
 			AF = (AF & ~0xfe) | (sum & 0x80) | (!(sum & 0xff) << 6) |
@@ -2310,8 +2196,9 @@ simz80(FASTREG PC)
 			if ((sum & 15) == 8 && (cbits & 16) != 0)
 				AF &= ~8;
 			break;
-		case 0xB2:			/* INIR */
+		EDCASE(0xB2):			/* INIR */
 			temp = hreg(BC);
+			TSTATES(21 * ((temp - 1) & 0xff));
 			do {
 				PutBYTE(HL, Input(lreg(BC))); ++HL;
 			} while (--temp);
@@ -2319,8 +2206,9 @@ simz80(FASTREG PC)
 			SETFLAG(N, 1);
 			SETFLAG(Z, 1);
 			break;
-		case 0xB3:			/* OTIR */
+		EDCASE(0xB3):			/* OTIR */
 			temp = hreg(BC);
+			TSTATES(21 * ((temp - 1) & 0xff));
 			do {
 				Output(lreg(BC), GetBYTE(HL)); ++HL;
 			} while (--temp);
@@ -2328,22 +2216,24 @@ simz80(FASTREG PC)
 			SETFLAG(N, 1);
 			SETFLAG(Z, 1);
 			break;
-		case 0xB8:			/* LDDR */
+		EDCASE(0xB8):			/* LDDR */
 			BC &= 0xffff;
+			TSTATES(21 * ((BC - 1) & 0xffff));
 			do {
 				acu = GetBYTE_mm(HL);
 				PutBYTE_mm(DE, acu);
-			} while (--BC);
+			} while ((BC = (BC - 1) & 0xffff) != 0);
 			acu += hreg(AF);
 			AF = (AF & ~0x3e) | (acu & 8) | ((acu & 2) << 4);
 			break;
-		case 0xB9:			/* CPDR */
+		EDCASE(0xB9):			/* CPDR */
 			acu = hreg(AF);
 			BC &= 0xffff;
 			do {
 				temp = GetBYTE_mm(HL);
-				op = --BC != 0;
+				op = (BC = (BC - 1) & 0xffff) != 0;
 				sum = acu - temp;
+				TAKEN(op && sum != 0, 21);
 			} while (op && sum != 0);
 			cbits = acu ^ temp ^ sum;
 			AF = (AF & ~0xfe) | (sum & 0x80) | (!(sum & 0xff) << 6) |
@@ -2353,8 +2243,9 @@ simz80(FASTREG PC)
 			if ((sum & 15) == 8 && (cbits & 16) != 0)
 				AF &= ~8;
 			break;
-		case 0xBA:			/* INDR */
+		EDCASE(0xBA):			/* INDR */
 			temp = hreg(BC);
+			TSTATES(21 * ((temp - 1) & 0xff));
 			do {
 				PutBYTE(HL, Input(lreg(BC))); --HL;
 			} while (--temp);
@@ -2362,8 +2253,9 @@ simz80(FASTREG PC)
 			SETFLAG(N, 1);
 			SETFLAG(Z, 1);
 			break;
-		case 0xBB:			/* OTDR */
+		EDCASE(0xBB):			/* OTDR */
 			temp = hreg(BC);
+			TSTATES(21 * ((temp - 1) & 0xff));
 			do {
 				Output(lreg(BC), GetBYTE(HL)); --HL;
 			} while (--temp);
@@ -2371,616 +2263,829 @@ simz80(FASTREG PC)
 			SETFLAG(N, 1);
 			SETFLAG(Z, 1);
 			break;
-		default: if (0x40 <= op && op <= 0x7f) PC--;		/* ignore ED */
+		DEFAULT(ed): if (0x40 <= op && op <= 0x7f) PC--;		/* ignore ED */
 		}
-		break;
-	case 0xEE:			/* XOR nn */
+		NEXT;
+	CASE(0xEE):			/* XOR nn */
 		sum = ((AF >> 8) ^ GetBYTE_pp(PC)) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xEF:			/* RST 28H */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xEF):			/* RST 28H */
 		PUSH(PC); PC = 0x28;
-		break;
-	case 0xF0:			/* RET P */
+		PROFILE_CALL();
+		goto branched;
+	CASE(0xF0):			/* RET P */
+		TAKEN(!TSTFLAG(S), 6);
 		if (!TSTFLAG(S)) POP(PC);
-		break;
-	case 0xF1:			/* POP AF */
+		goto branched;
+	CASE(0xF1):			/* POP AF */
 		POP(AF);
-		break;
-	case 0xF2:			/* JP P,nnnn */
+		NEXT;
+	CASE(0xF2):			/* JP P,nnnn */
 		JPC(!TSTFLAG(S));
-		break;
-	case 0xF3:			/* DI */
-		IFF = 0;
-		break;
-	case 0xF4:			/* CALL P,nnnn */
+		goto branched;
+	CASE(0xF3):			/* DI */
+		m->IFF = 0;
+		NEXT;
+	CASE(0xF4):			/* CALL P,nnnn */
 		CALLC(!TSTFLAG(S));
-		break;
-	case 0xF5:			/* PUSH AF */
+		goto branched;
+	CASE(0xF5):			/* PUSH AF */
 		PUSH(AF);
-		break;
-	case 0xF6:			/* OR nn */
+		NEXT;
+	CASE(0xF6):			/* OR nn */
 		sum = ((AF >> 8) | GetBYTE_pp(PC)) & 0xff;
-		AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
-		break;
-	case 0xF7:			/* RST 30H */
+		AF = (sum << 8) | szptab[sum];
+		NEXT;
+	CASE(0xF7):			/* RST 30H */
 		PUSH(PC); PC = 0x30;
-		break;
-	case 0xF8:			/* RET M */
+		PROFILE_CALL();
+		goto branched;
+	CASE(0xF8):			/* RET M */
+		TAKEN(TSTFLAG(S), 6);
 		if (TSTFLAG(S)) POP(PC);
-		break;
-	case 0xF9:			/* LD SP,HL */
+		goto branched;
+	CASE(0xF9):			/* LD SP,HL */
 		SP = HL;
-		break;
-	case 0xFA:			/* JP M,nnnn */
+		NEXT;
+	CASE(0xFA):			/* JP M,nnnn */
 		JPC(TSTFLAG(S));
-		break;
-	case 0xFB:			/* EI */
-		IFF = 3;
-		break;
-	case 0xFC:			/* CALL M,nnnn */
+		goto branched;
+	CASE(0xFB):			/* EI */
+		m->IFF = 3;
+		NEXT;
+	CASE(0xFC):			/* CALL M,nnnn */
 		CALLC(TSTFLAG(S));
-		break;
-	case 0xFD:			/* FD prefix */
-		switch (op = GetBYTE_pp(PC)) {
-		case 0x09:			/* ADD IY,BC */
-			IY &= 0xffff;
+		goto branched;
+	CASE(0xFD):			/* FD prefix */
+		XY = IY;
+		op = 0xfd;
+	indexed:			/* DD and FD share the code, on XY */
+		PROFILE_OP(op == 0xdd ? OPS_DD : OPS_FD, tindexed, RAM(PC));
+#ifdef THREADED
+		goto *xytab[GetBYTE_pp(PC)];
+#endif
+		switch (GetBYTE_pp(PC)) {
+		XYCASE(0x09):			/* ADD XY,BC */
+			XY &= 0xffff;
 			BC &= 0xffff;
-			sum = IY + BC;
-			cbits = (IY ^ BC ^ sum) >> 8;
-			IY = sum;
+			sum = XY + BC;
+			cbits = (XY ^ BC ^ sum) >> 8;
+			XY = sum;
 			AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
 				(cbits & 0x10) | ((cbits >> 8) & 1);
 			break;
-		case 0x19:			/* ADD IY,DE */
-			IY &= 0xffff;
+		XYCASE(0x19):			/* ADD XY,DE */
+			XY &= 0xffff;
 			DE &= 0xffff;
-			sum = IY + DE;
-			cbits = (IY ^ DE ^ sum) >> 8;
-			IY = sum;
+			sum = XY + DE;
+			cbits = (XY ^ DE ^ sum) >> 8;
+			XY = sum;
 			AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
 				(cbits & 0x10) | ((cbits >> 8) & 1);
 			break;
-		case 0x21:			/* LD IY,nnnn */
-			IY = GetWORD(PC);
+		XYCASE(0x21):			/* LD XY,nnnn */
+			XY = GetWORD(PC);
 			PC += 2;
 			break;
-		case 0x22:			/* LD (nnnn),IY */
+		XYCASE(0x22):			/* LD (nnnn),XY */
 			temp = GetWORD(PC);
-			PutWORD(temp, IY);
+			PutWORD(temp, XY);
 			PC += 2;
 			break;
-		case 0x23:			/* INC IY */
-			++IY;
-			break;
-		case 0x24:			/* INC IYH */
-			IY += 0x100;
-			temp = hreg(IY);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				(((temp & 0xf) == 0) << 4) |
-				((temp == 0x80) << 2);
-			break;
-		case 0x25:			/* DEC IYH */
-			IY -= 0x100;
-			temp = hreg(IY);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				(((temp & 0xf) == 0xf) << 4) |
-				((temp == 0x7f) << 2) | 2;
-			break;
-		case 0x26:			/* LD IYH,nn */
-			Sethreg(IY, GetBYTE_pp(PC));
-			break;
-		case 0x29:			/* ADD IY,IY */
-			IY &= 0xffff;
-			sum = IY + IY;
-			cbits = (IY ^ IY ^ sum) >> 8;
-			IY = sum;
+		XYCASE(0x23):			/* INC XY */
+			++XY;
+			break;
+		XYCASE(0x24):			/* INC XYH */
+			XY += 0x100;
+			temp = hreg(XY);
+			AF = (AF & ~0xfe) | inctab[temp & 0xff];
+			break;
+		XYCASE(0x25):			/* DEC XYH */
+			XY -= 0x100;
+			temp = hreg(XY);
+			AF = (AF & ~0xfe) | dectab[temp & 0xff];
+			break;
+		XYCASE(0x26):			/* LD XYH,nn */
+			Sethreg(XY, GetBYTE_pp(PC));
+			break;
+		XYCASE(0x29):			/* ADD XY,XY */
+			XY &= 0xffff;
+			sum = XY + XY;
+			cbits = (XY ^ XY ^ sum) >> 8;
+			XY = sum;
 			AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
 				(cbits & 0x10) | ((cbits >> 8) & 1);
 			break;
-		case 0x2A:			/* LD IY,(nnnn) */
+		XYCASE(0x2A):			/* LD XY,(nnnn) */
 			temp = GetWORD(PC);
-			IY = GetWORD(temp);
+			XY = GetWORD(temp);
 			PC += 2;
 			break;
-		case 0x2B:			/* DEC IY */
-			--IY;
-			break;
-		case 0x2C:			/* INC IYL */
-			temp = lreg(IY)+1;
-			Setlreg(IY, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				(((temp & 0xf) == 0) << 4) |
-				((temp == 0x80) << 2);
-			break;
-		case 0x2D:			/* DEC IYL */
-			temp = lreg(IY)-1;
-			Setlreg(IY, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				(((temp & 0xf) == 0xf) << 4) |
-				((temp == 0x7f) << 2) | 2;
-			break;
-		case 0x2E:			/* LD IYL,nn */
-			Setlreg(IY, GetBYTE_pp(PC));
-			break;
-		case 0x34:			/* INC (IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x2B):			/* DEC XY */
+			--XY;
+			break;
+		XYCASE(0x2C):			/* INC XYL */
+			temp = lreg(XY)+1;
+			Setlreg(XY, temp);
+			AF = (AF & ~0xfe) | inctab[temp & 0xff];
+			break;
+		XYCASE(0x2D):			/* DEC XYL */
+			temp = lreg(XY)-1;
+			Setlreg(XY, temp);
+			AF = (AF & ~0xfe) | dectab[temp & 0xff];
+			break;
+		XYCASE(0x2E):			/* LD XYL,nn */
+			Setlreg(XY, GetBYTE_pp(PC));
+			break;
+		XYCASE(0x34):			/* INC (XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			temp = GetBYTE(adr)+1;
 			PutBYTE(adr, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				(((temp & 0xf) == 0) << 4) |
-				((temp == 0x80) << 2);
+			AF = (AF & ~0xfe) | inctab[temp & 0xff];
 			break;
-		case 0x35:			/* DEC (IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x35):			/* DEC (XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			temp = GetBYTE(adr)-1;
 			PutBYTE(adr, temp);
-			AF = (AF & ~0xfe) | (temp & 0xa8) |
-				(((temp & 0xff) == 0) << 6) |
-				(((temp & 0xf) == 0xf) << 4) |
-				((temp == 0x7f) << 2) | 2;
+			AF = (AF & ~0xfe) | dectab[temp & 0xff];
 			break;
-		case 0x36:			/* LD (IY+dd),nn */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x36):			/* LD (XY+dd),nn */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			PutBYTE(adr, GetBYTE_pp(PC));
 			break;
-		case 0x39:			/* ADD IY,SP */
-			IY &= 0xffff;
+		XYCASE(0x39):			/* ADD XY,SP */
+			XY &= 0xffff;
 			SP &= 0xffff;
-			sum = IY + SP;
-			cbits = (IY ^ SP ^ sum) >> 8;
-			IY = sum;
+			sum = XY + SP;
+			cbits = (XY ^ SP ^ sum) >> 8;
+			XY = sum;
 			AF = (AF & ~0x3b) | ((sum >> 8) & 0x28) |
 				(cbits & 0x10) | ((cbits >> 8) & 1);
 			break;
-		case 0x44:			/* LD B,IYH */
-			Sethreg(BC, hreg(IY));
+		XYCASE(0x44):			/* LD B,XYH */
+			Sethreg(BC, hreg(XY));
 			break;
-		case 0x45:			/* LD B,IYL */
-			Sethreg(BC, lreg(IY));
+		XYCASE(0x45):			/* LD B,XYL */
+			Sethreg(BC, lreg(XY));
 			break;
-		case 0x46:			/* LD B,(IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x46):			/* LD B,(XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			Sethreg(BC, GetBYTE(adr));
 			break;
-		case 0x4C:			/* LD C,IYH */
-			Setlreg(BC, hreg(IY));
+		XYCASE(0x4C):			/* LD C,XYH */
+			Setlreg(BC, hreg(XY));
 			break;
-		case 0x4D:			/* LD C,IYL */
-			Setlreg(BC, lreg(IY));
+		XYCASE(0x4D):			/* LD C,XYL */
+			Setlreg(BC, lreg(XY));
 			break;
-		case 0x4E:			/* LD C,(IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x4E):			/* LD C,(XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			Setlreg(BC, GetBYTE(adr));
 			break;
-		case 0x54:			/* LD D,IYH */
-			Sethreg(DE, hreg(IY));
+		XYCASE(0x54):			/* LD D,XYH */
+			Sethreg(DE, hreg(XY));
 			break;
-		case 0x55:			/* LD D,IYL */
-			Sethreg(DE, lreg(IY));
+		XYCASE(0x55):			/* LD D,XYL */
+			Sethreg(DE, lreg(XY));
 			break;
-		case 0x56:			/* LD D,(IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x56):			/* LD D,(XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			Sethreg(DE, GetBYTE(adr));
 			break;
-		case 0x5C:			/* LD E,H */
-			Setlreg(DE, hreg(IY));
+		XYCASE(0x5C):			/* LD E,H */
+			Setlreg(DE, hreg(XY));
 			break;
-		case 0x5D:			/* LD E,L */
-			Setlreg(DE, lreg(IY));
+		XYCASE(0x5D):			/* LD E,L */
+			Setlreg(DE, lreg(XY));
 			break;
-		case 0x5E:			/* LD E,(IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x5E):			/* LD E,(XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			Setlreg(DE, GetBYTE(adr));
 			break;
-		case 0x60:			/* LD IYH,B */
-			Sethreg(IY, hreg(BC));
+		XYCASE(0x60):			/* LD XYH,B */
+			Sethreg(XY, hreg(BC));
 			break;
-		case 0x61:			/* LD IYH,C */
-			Sethreg(IY, lreg(BC));
+		XYCASE(0x61):			/* LD XYH,C */
+			Sethreg(XY, lreg(BC));
 			break;
-		case 0x62:			/* LD IYH,D */
-			Sethreg(IY, hreg(DE));
+		XYCASE(0x62):			/* LD XYH,D */
+			Sethreg(XY, hreg(DE));
 			break;
-		case 0x63:			/* LD IYH,E */
-			Sethreg(IY, lreg(DE));
+		XYCASE(0x63):			/* LD XYH,E */
+			Sethreg(XY, lreg(DE));
 			break;
-		case 0x64:			/* LD IYH,IYH */
+		XYCASE(0x64):			/* LD XYH,XYH */
 			/* nop */
 			break;
-		case 0x65:			/* LD IYH,IYL */
-			Sethreg(IY, lreg(IY));
+		XYCASE(0x65):			/* LD XYH,XYL */
+			Sethreg(XY, lreg(XY));
 			break;
-		case 0x66:			/* LD H,(IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x66):			/* LD H,(XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			Sethreg(HL, GetBYTE(adr));
 			break;
-		case 0x67:			/* LD IYH,A */
-			Sethreg(IY, hreg(AF));
+		XYCASE(0x67):			/* LD XYH,A */
+			Sethreg(XY, hreg(AF));
 			break;
-		case 0x68:			/* LD IYL,B */
-			Setlreg(IY, hreg(BC));
+		XYCASE(0x68):			/* LD XYL,B */
+			Setlreg(XY, hreg(BC));
 			break;
-		case 0x69:			/* LD IYL,C */
-			Setlreg(IY, lreg(BC));
+		XYCASE(0x69):			/* LD XYL,C */
+			Setlreg(XY, lreg(BC));
 			break;
-		case 0x6A:			/* LD IYL,D */
-			Setlreg(IY, hreg(DE));
+		XYCASE(0x6A):			/* LD XYL,D */
+			Setlreg(XY, hreg(DE));
 			break;
-		case 0x6B:			/* LD IYL,E */
-			Setlreg(IY, lreg(DE));
+		XYCASE(0x6B):			/* LD XYL,E */
+			Setlreg(XY, lreg(DE));
 			break;
-		case 0x6C:			/* LD IYL,IYH */
-			Setlreg(IY, hreg(IY));
+		XYCASE(0x6C):			/* LD XYL,XYH */
+			Setlreg(XY, hreg(XY));
 			break;
-		case 0x6D:			/* LD IYL,IYL */
+		XYCASE(0x6D):			/* LD XYL,XYL */
 			/* nop */
 			break;
-		case 0x6E:			/* LD L,(IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x6E):			/* LD L,(XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			Setlreg(HL, GetBYTE(adr));
 			break;
-		case 0x6F:			/* LD IYL,A */
-			Setlreg(IY, hreg(AF));
+		XYCASE(0x6F):			/* LD XYL,A */
+			Setlreg(XY, hreg(AF));
 			break;
-		case 0x70:			/* LD (IY+dd),B */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x70):			/* LD (XY+dd),B */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			PutBYTE(adr, hreg(BC));
 			break;
-		case 0x71:			/* LD (IY+dd),C */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x71):			/* LD (XY+dd),C */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			PutBYTE(adr, lreg(BC));
 			break;
-		case 0x72:			/* LD (IY+dd),D */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x72):			/* LD (XY+dd),D */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			PutBYTE(adr, hreg(DE));
 			break;
-		case 0x73:			/* LD (IY+dd),E */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x73):			/* LD (XY+dd),E */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			PutBYTE(adr, lreg(DE));
 			break;
-		case 0x74:			/* LD (IY+dd),H */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x74):			/* LD (XY+dd),H */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			PutBYTE(adr, hreg(HL));
 			break;
-		case 0x75:			/* LD (IY+dd),L */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x75):			/* LD (XY+dd),L */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			PutBYTE(adr, lreg(HL));
 			break;
-		case 0x77:			/* LD (IY+dd),A */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x77):			/* LD (XY+dd),A */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			PutBYTE(adr, hreg(AF));
 			break;
-		case 0x7C:			/* LD A,IYH */
-			Sethreg(AF, hreg(IY));
+		XYCASE(0x7C):			/* LD A,XYH */
+			Sethreg(AF, hreg(XY));
 			break;
-		case 0x7D:			/* LD A,IYL */
-			Sethreg(AF, lreg(IY));
+		XYCASE(0x7D):			/* LD A,XYL */
+			Sethreg(AF, lreg(XY));
 			break;
-		case 0x7E:			/* LD A,(IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x7E):			/* LD A,(XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			Sethreg(AF, GetBYTE(adr));
 			break;
-		case 0x84:			/* ADD A,IYH */
-			temp = hreg(IY);
+		XYCASE(0x84):			/* ADD A,XYH */
+			temp = hreg(XY);
 			acu = hreg(AF);
 			sum = acu + temp;
 			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				((cbits >> 8) & 1);
+			AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
 			break;
-		case 0x85:			/* ADD A,IYL */
-			temp = lreg(IY);
+		XYCASE(0x85):			/* ADD A,XYL */
+			temp = lreg(XY);
 			acu = hreg(AF);
 			sum = acu + temp;
 			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				((cbits >> 8) & 1);
+			AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
 			break;
-		case 0x86:			/* ADD A,(IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x86):			/* ADD A,(XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			temp = GetBYTE(adr);
 			acu = hreg(AF);
 			sum = acu + temp;
 			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				((cbits >> 8) & 1);
+			AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
 			break;
-		case 0x8C:			/* ADC A,IYH */
-			temp = hreg(IY);
+		XYCASE(0x8C):			/* ADC A,XYH */
+			temp = hreg(XY);
 			acu = hreg(AF);
 			sum = acu + temp + TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				((cbits >> 8) & 1);
+			AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
 			break;
-		case 0x8D:			/* ADC A,IYL */
-			temp = lreg(IY);
+		XYCASE(0x8D):			/* ADC A,XYL */
+			temp = lreg(XY);
 			acu = hreg(AF);
 			sum = acu + temp + TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				((cbits >> 8) & 1);
+			AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
 			break;
-		case 0x8E:			/* ADC A,(IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x8E):			/* ADC A,(XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			temp = GetBYTE(adr);
 			acu = hreg(AF);
 			sum = acu + temp + TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) |
-				((cbits >> 8) & 1);
+			AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] | cbitstab[cbits & 0x1ff];
 			break;
-		case 0x94:			/* SUB IYH */
-			temp = hreg(IY);
+		XYCASE(0x94):			/* SUB XYH */
+			temp = hreg(XY);
 			acu = hreg(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				((cbits >> 8) & 1);
+			AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+				cbitstab[cbits & 0x1ff] | 2;
 			break;
-		case 0x95:			/* SUB IYL */
-			temp = lreg(IY);
+		XYCASE(0x95):			/* SUB XYL */
+			temp = lreg(XY);
 			acu = hreg(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				((cbits >> 8) & 1);
+			AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+				cbitstab[cbits & 0x1ff] | 2;
 			break;
-		case 0x96:			/* SUB (IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x96):			/* SUB (XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			temp = GetBYTE(adr);
 			acu = hreg(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				((cbits >> 8) & 1);
+			AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+				cbitstab[cbits & 0x1ff] | 2;
 			break;
-		case 0x9C:			/* SBC A,IYH */
-			temp = hreg(IY);
+		XYCASE(0x9C):			/* SBC A,XYH */
+			temp = hreg(XY);
 			acu = hreg(AF);
 			sum = acu - temp - TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				((cbits >> 8) & 1);
+			AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+				cbitstab[cbits & 0x1ff] | 2;
 			break;
-		case 0x9D:			/* SBC A,IYL */
-			temp = lreg(IY);
+		XYCASE(0x9D):			/* SBC A,XYL */
+			temp = lreg(XY);
 			acu = hreg(AF);
 			sum = acu - temp - TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				((cbits >> 8) & 1);
+			AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+				cbitstab[cbits & 0x1ff] | 2;
 			break;
-		case 0x9E:			/* SBC A,(IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0x9E):			/* SBC A,(XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			temp = GetBYTE(adr);
 			acu = hreg(AF);
 			sum = acu - temp - TSTFLAG(C);
 			cbits = acu ^ temp ^ sum;
-			AF = ((sum & 0xff) << 8) | (sum & 0xa8) |
-				(((sum & 0xff) == 0) << 6) | (cbits & 0x10) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				((cbits >> 8) & 1);
-			break;
-		case 0xA4:			/* AND IYH */
-			sum = ((AF & (IY)) >> 8) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) |
-				((sum == 0) << 6) | 0x10 | partab[sum];
-			break;
-		case 0xA5:			/* AND IYL */
-			sum = ((AF >> 8) & IY) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-				((sum == 0) << 6) | partab[sum];
-			break;
-		case 0xA6:			/* AND (IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+			AF = ((sum & 0xff) << 8) | sztab[sum & 0xff] |
+				cbitstab[cbits & 0x1ff] | 2;
+			break;
+		XYCASE(0xA4):			/* AND XYH */
+			sum = ((AF & (XY)) >> 8) & 0xff;
+			AF = (sum << 8) | szptab[sum] | 0x10;
+			break;
+		XYCASE(0xA5):			/* AND XYL */
+			sum = ((AF >> 8) & XY) & 0xff;
+			AF = (sum << 8) | szptab[sum] | 0x10;
+			break;
+		XYCASE(0xA6):			/* AND (XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			sum = ((AF >> 8) & GetBYTE(adr)) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | 0x10 |
-				((sum == 0) << 6) | partab[sum];
+			AF = (sum << 8) | szptab[sum] | 0x10;
 			break;
-		case 0xAC:			/* XOR IYH */
-			sum = ((AF ^ (IY)) >> 8) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+		XYCASE(0xAC):			/* XOR XYH */
+			sum = ((AF ^ (XY)) >> 8) & 0xff;
+			AF = (sum << 8) | szptab[sum];
 			break;
-		case 0xAD:			/* XOR IYL */
-			sum = ((AF >> 8) ^ IY) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+		XYCASE(0xAD):			/* XOR XYL */
+			sum = ((AF >> 8) ^ XY) & 0xff;
+			AF = (sum << 8) | szptab[sum];
 			break;
-		case 0xAE:			/* XOR (IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0xAE):			/* XOR (XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			sum = ((AF >> 8) ^ GetBYTE(adr)) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+			AF = (sum << 8) | szptab[sum];
 			break;
-		case 0xB4:			/* OR IYH */
-			sum = ((AF | (IY)) >> 8) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+		XYCASE(0xB4):			/* OR XYH */
+			sum = ((AF | (XY)) >> 8) & 0xff;
+			AF = (sum << 8) | szptab[sum];
 			break;
-		case 0xB5:			/* OR IYL */
-			sum = ((AF >> 8) | IY) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+		XYCASE(0xB5):			/* OR XYL */
+			sum = ((AF >> 8) | XY) & 0xff;
+			AF = (sum << 8) | szptab[sum];
 			break;
-		case 0xB6:			/* OR (IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0xB6):			/* OR (XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			sum = ((AF >> 8) | GetBYTE(adr)) & 0xff;
-			AF = (sum << 8) | (sum & 0xa8) | ((sum == 0) << 6) | partab[sum];
+			AF = (sum << 8) | szptab[sum];
 			break;
-		case 0xBC:			/* CP IYH */
-			temp = hreg(IY);
+		XYCASE(0xBC):			/* CP XYH */
+			temp = hreg(XY);
 			AF = (AF & ~0x28) | (temp & 0x28);
 			acu = hreg(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = (AF & ~0xff) | (sum & 0x80) |
-				(((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				(cbits & 0x10) | ((cbits >> 8) & 1);
+			AF = (AF & ~0xff) | (sztab[sum & 0xff] & 0xc0) | (temp & 0x28) |
+				cbitstab[cbits & 0x1ff] | 2;
 			break;
-		case 0xBD:			/* CP IYL */
-			temp = lreg(IY);
+		XYCASE(0xBD):			/* CP XYL */
+			temp = lreg(XY);
 			AF = (AF & ~0x28) | (temp & 0x28);
 			acu = hreg(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = (AF & ~0xff) | (sum & 0x80) |
-				(((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				(cbits & 0x10) | ((cbits >> 8) & 1);
+			AF = (AF & ~0xff) | (sztab[sum & 0xff] & 0xc0) | (temp & 0x28) |
+				cbitstab[cbits & 0x1ff] | 2;
 			break;
-		case 0xBE:			/* CP (IY+dd) */
-			adr = IY + (signed char) GetBYTE_pp(PC);
+		XYCASE(0xBE):			/* CP (XY+dd) */
+			adr = XY + (signed char) GetBYTE_pp(PC);
 			temp = GetBYTE(adr);
 			AF = (AF & ~0x28) | (temp & 0x28);
 			acu = hreg(AF);
 			sum = acu - temp;
 			cbits = acu ^ temp ^ sum;
-			AF = (AF & ~0xff) | (sum & 0x80) |
-				(((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-				(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-				(cbits & 0x10) | ((cbits >> 8) & 1);
-			break;
-		case 0xCB:			/* CB prefix */
-			adr = IY + (signed char) GetBYTE_pp(PC);
-			adr = adr;
-			switch ((op = GetBYTE(PC)) & 7) {
-			case 0: ++PC; acu = hreg(BC); break;
-			case 1: ++PC; acu = lreg(BC); break;
-			case 2: ++PC; acu = hreg(DE); break;
-			case 3: ++PC; acu = lreg(DE); break;
-			case 4: ++PC; acu = hreg(HL); break;
-			case 5: ++PC; acu = lreg(HL); break;
-			case 6: ++PC; acu = GetBYTE(adr);  break;
-			case 7: ++PC; acu = hreg(AF); break;
-			}
-			switch (op & 0xc0) {
-			case 0x00:		/* shift/rotate */
-				switch (op & 0x38) {
-				case 0x00:	/* RLC */
-					temp = (acu << 1) | (acu >> 7);
-					cbits = temp & 1;
-					goto cbshflg3;
-				case 0x08:	/* RRC */
-					temp = (acu >> 1) | (acu << 7);
-					cbits = temp & 0x80;
-					goto cbshflg3;
-				case 0x10:	/* RL */
-					temp = (acu << 1) | TSTFLAG(C);
-					cbits = acu & 0x80;
-					goto cbshflg3;
-				case 0x18:	/* RR */
-					temp = (acu >> 1) | (TSTFLAG(C) << 7);
-					cbits = acu & 1;
-					goto cbshflg3;
-				case 0x20:	/* SLA */
-					temp = acu << 1;
-					cbits = acu & 0x80;
-					goto cbshflg3;
-				case 0x28:	/* SRA */
-					temp = (acu >> 1) | (acu & 0x80);
-					cbits = acu & 1;
-					goto cbshflg3;
-				case 0x30:	/* SLIA */
-					temp = (acu << 1) | 1;
-					cbits = acu & 0x80;
-					goto cbshflg3;
-				case 0x38:	/* SRL */
-					temp = acu >> 1;
-					cbits = acu & 1;
-				cbshflg3:
-					AF = (AF & ~0xff) | (temp & 0xa8) |
-						(((temp & 0xff) == 0) << 6) |
-						parity(temp) | !!cbits;
-				}
-				break;
-			case 0x40:		/* BIT */
-				if (acu & (1 << ((op >> 3) & 7)))
-					AF = (AF & ~0xfe) | 0x10 |
-					(((op & 0x38) == 0x38) << 7);
-				else
-					AF = (AF & ~0xfe) | 0x54;
-				if ((op&7) != 6)
-					AF |= (acu & 0x28);
-				temp = acu;
-				break;
-			case 0x80:		/* RES */
-				temp = acu & ~(1 << ((op >> 3) & 7));
-				break;
-			case 0xc0:		/* SET */
-				temp = acu | (1 << ((op >> 3) & 7));
-				break;
-			}
-			switch (op & 7) {
-			case 0: Sethreg(BC, temp); break;
-			case 1: Setlreg(BC, temp); break;
-			case 2: Sethreg(DE, temp); break;
-			case 3: Setlreg(DE, temp); break;
-			case 4: Sethreg(HL, temp); break;
-			case 5: Setlreg(HL, temp); break;
-			case 6: PutBYTE(adr, temp);  break;
-			case 7: Sethreg(AF, temp); break;
-			}
-			break;
-		case 0xE1:			/* POP IY */
-			POP(IY);
+			AF = (AF & ~0xff) | (sztab[sum & 0xff] & 0xc0) | (temp & 0x28) |
+				cbitstab[cbits & 0x1ff] | 2;
 			break;
-		case 0xE3:			/* EX (SP),IY */
-			temp = IY; POP(IY); PUSH(temp);
+		XYCASE(0xCB):			/* CB prefix */
+			adr = XY + (signed char) GetBYTE_pp(PC);
+			PROFILE_OP(op == 0xdd ? OPS_DDCB : OPS_FDCB, tindexedcb, RAM(PC));
+			goto cbprefix;
+		XYCASE(0xE1):			/* POP XY */
+			POP(XY);
 			break;
-		case 0xE5:			/* PUSH IY */
-			PUSH(IY);
+		XYCASE(0xE3):			/* EX (SP),XY */
+			temp = XY; POP(XY); PUSH(temp);
 			break;
-		case 0xE9:			/* JP (IY) */
-			PC = IY;
+		XYCASE(0xE5):			/* PUSH XY */
+			PUSH(XY);
 			break;
-		case 0xF9:			/* LD SP,IY */
-			SP = IY;
+		XYCASE(0xE9):			/* JP (XY) */
+			PC = XY;
+			goto branched;
+		XYCASE(0xF9):			/* LD SP,XY */
+			SP = XY;
 			break;
-		default: PC--;		/* ignore DD */
+		DEFAULT(xy): PC--;		/* ignore DD/FD */
 		}
-		break;
-	case 0xFE:			/* CP nn */
+		if (op == 0xdd)
+			IX = XY;
+		else
+			IY = XY;
+		NEXT;
+	CASE(0xFE):			/* CP nn */
 		temp = GetBYTE_pp(PC);
 		AF = (AF & ~0x28) | (temp & 0x28);
 		acu = hreg(AF);
 		sum = acu - temp;
 		cbits = acu ^ temp ^ sum;
-		AF = (AF & ~0xff) | (sum & 0x80) |
-			(((sum & 0xff) == 0) << 6) | (temp & 0x28) |
-			(((cbits >> 6) ^ (cbits >> 5)) & 4) | 2 |
-			(cbits & 0x10) | ((cbits >> 8) & 1);
-		break;
-	case 0xFF:			/* RST 38H */
+		AF = (AF & ~0xff) | (sztab[sum & 0xff] & 0xc0) | (temp & 0x28) |
+			cbitstab[cbits & 0x1ff] | 2;
+		NEXT;
+	CASE(0xFF):			/* RST 38H */
 		PUSH(PC); PC = 0x38;
+		PROFILE_CALL();
+		goto branched;
+    }
+    if (memhook) {
+	reason = STOP_HOOK;
+	goto stop;
+    }
+    goto next;
+#ifdef THREADED
+/* the CB opcodes, from cbtab */
+    {
+	CBROW(cb_rlc, CBSHIFT(temp = (acu << 1) | (acu >> 7); cbits = temp & 1));
+	CBROW(cb_rrc, CBSHIFT(temp = (acu >> 1) | (acu << 7); cbits = temp & 0x80));
+	CBROW(cb_rl, CBSHIFT(temp = (acu << 1) | TSTFLAG(C); cbits = acu & 0x80));
+	CBROW(cb_rr, CBSHIFT(temp = (acu >> 1) | (TSTFLAG(C) << 7); cbits = acu & 1));
+	CBROW(cb_sla, CBSHIFT(temp = acu << 1; cbits = acu & 0x80));
+	CBROW(cb_sra, CBSHIFT(temp = (acu >> 1) | (acu & 0x80); cbits = acu & 1));
+	CBROW(cb_slia, CBSHIFT(temp = (acu << 1) | 1; cbits = acu & 0x80));
+	CBROW(cb_srl, CBSHIFT(temp = acu >> 1; cbits = acu & 1));
+	CBBITROW(0); CBBITROW(1); CBBITROW(2); CBBITROW(3);
+	CBBITROW(4); CBBITROW(5); CBBITROW(6); CBBITROW(7);
+	CBROW(cb_res0, temp = acu & ~0x01); CBROW(cb_res1, temp = acu & ~0x02);
+	CBROW(cb_res2, temp = acu & ~0x04); CBROW(cb_res3, temp = acu & ~0x08);
+	CBROW(cb_res4, temp = acu & ~0x10); CBROW(cb_res5, temp = acu & ~0x20);
+	CBROW(cb_res6, temp = acu & ~0x40); CBROW(cb_res7, temp = acu & ~0x80);
+	CBROW(cb_set0, temp = acu | 0x01); CBROW(cb_set1, temp = acu | 0x02);
+	CBROW(cb_set2, temp = acu | 0x04); CBROW(cb_set3, temp = acu | 0x08);
+	CBROW(cb_set4, temp = acu | 0x10); CBROW(cb_set5, temp = acu | 0x20);
+	CBROW(cb_set6, temp = acu | 0x40); CBROW(cb_set7, temp = acu | 0x80);
+    }
+#endif
+/* breakpoints are only checked after instructions that can branch */
+branched:
+    if (TSTSTOP(m->breakmap, PC)) {
+	SAVE_STATE();
+	reason = m->breakhook(m, PC & 0xffff);
+	LOAD_STATE();
+	if (reason) {
+	    reason = STOP_BREAK;
+	    goto stop;
+	}
+    }
+    if (memhook) {
+	reason = STOP_HOOK;
+	goto stop;
+    }
+#ifdef BLOCKCACHE
+    if (blocks)
+	goto block;
+#endif
+    goto next;
+#ifdef BLOCKCACHE
+/* a branch ends the block being recorded; the one at the target runs if
+   it is in the cache and the budget lasts for it, else it is recorded */
+block:
+    if (blk != NULL && blk->n == 0)
+	blockfree(m, blk);
+    blk = NULL;
+    ENTER_AOT();
+    {
+	block_struct *b = &blocks->block[PC & (BLOCKS-1)];
+
+	if (b->live && b->start == (PC & 0xffff)) {
+	    if (b->n > budget)
+		goto next;
+	    budget -= b->n;
+	    bn = b->n - 1;
+	    bp = b->op + 1;
+	    PC++;
+	    goto *b->op[0];
+	}
+	blockfree(m, b);
+	b->start = PC;
+	b->end = b->start;
+	b->live = 1;
+	blk = b;
+    }
+    goto next;
+/* an instruction that still runs in the block being recorded */
+record:
+    if (!blk->live || blk->n == BLOCKOPS)	/* written over or full */
+	blk = NULL;
+    else {
+	blk->op[blk->n++] = optab[RAM(PC)];
+	if (blk->start + ((PC - blk->start) & 0xffff) + 4 > blk->end)
+	    blockgrow(m, blk, blk->start + ((PC - blk->start) & 0xffff) + 4);
     }
+    goto *optab[RAM_pp(PC)];
+/* the running block was written over, interpret the rest of it */
+blockexit:
+    PC--;
+    budget += bn + 1;
+    bn = 0;
+    goto next;
+#endif
+#if defined(ROMAOT) && !defined(DEBUG) && !defined(PROFILE)
+translated:
+#ifdef BLOCKCACHE
+    if (blk != NULL && blk->n == 0)
+	blockfree(m, blk);
+    blk = NULL;
+#endif
+    switch (PC) {
+#include "romaot.h"
     }
-/* make registers visible for debugging if interrupted */
+    goto next;
+#endif
+stop:
+#ifdef BLOCKCACHE
+    if (blk != NULL && blk->n == 0)
+	blockfree(m, blk);
+    budget += bn;		/* not run from the block */
+#endif
+/* make registers visible to the caller */
     SAVE_STATE();
-    return (PC&0xffff)|0x10000;	/* flag non-bios stop */
+    m->pc &= 0xffff;
+    m->icount += reason == STOP_BUDGET ? start : start - budget;
+#ifdef PROFILE
+    if (profile != NULL)
+	profile->pctstates[ppc] += tstates - ptstates;
+    m->tstates = tstates;
+#endif
+    return reason;
+}
+
+#if defined(ROMAOT) && !defined(DEBUG) && !defined(PROFILE)
+/* a write that changes the ROM disables the run of translated code it
+   falls in; a ROM mapped read-only does not change */
+static int
+aotwritten(machine_struct *m, WORD addr, BYTE value)
+{
+    int lo = 0, hi = sizeof(aotruns) / sizeof(aotruns[0]) - 1;
+    unsigned int a;
+#ifndef MMU
+    BYTE *const *const rpage = m->rpage;
+#endif
+
+    if (RAM(addr) == aotimage[addr])
+	return 0;
+
+    while (lo <= hi) {
+	int mid = (lo + hi) / 2;
+
+	if (addr < aotruns[mid][0])
+	    hi = mid - 1;
+	else if (addr > aotruns[mid][1])
+	    lo = mid + 1;
+	else {
+	    for (a = aotruns[mid][0]; a <= aotruns[mid][1]; a++)
+		CLRSTOP(m->aotmap, a);
+	    break;
+	}
+    }
+    return 0;
+}
+#endif
+
+/* enables the translated ROM code for the runs of instructions that are
+   in the machine's memory as they were when translated, and watches the
+   ROM to disable them if they are written later; call it again after
+   clearwatches() */
+void
+simz80_aot(machine_struct *m)
+{
+    memset(m->aotmap, 0, sizeof(m->aotmap));
+#if defined(ROMAOT) && !defined(DEBUG) && !defined(PROFILE)
+    {
+	unsigned int i, a;
+
+	for (i = 0; i < (unsigned int) m->nwatches; i++)
+	    if (m->watches[i].hook == aotwritten)
+		break;
+	if (i == (unsigned int) m->nwatches && addwatch(m, 0, AOTTOP-1, aotwritten))
+	    return;		/* no watches left, no translated code */
+	for (i = 0; i < sizeof(aotruns) / sizeof(aotruns[0]); i++) {
+	    unsigned int first = aotruns[i][0], last = aotruns[i][1];
+
+#ifndef MMU
+	    BYTE *const *const rpage = m->rpage;
+#endif
+
+	    for (a = first; a <= last; a++)
+		if (RAM(a) != aotimage[a])
+		    break;
+	    if (a <= last)
+		continue;
+	    for (a = first; a <= last; a++)
+		if (TSTSTOP(aotinsns, a))
+		    SETSTOP(m->aotmap, a);
+	}
+    }
+#endif
+}
+
+/* on enables the block cache of m, which must start NULL, or empties it
+   when it is already on; call it again after changing the memory other
+   than by running code. Returns -1 when there is no cache (without
+   THREADED, or out of memory). */
+int
+simz80_blocks(machine_struct *m, int on)
+{
+#ifdef BLOCKCACHE
+    if (m->blocks != NULL) {
+	int w = blockwatched(m);
+
+	blockflush(m);
+	if (!on) {
+	    if (w >= 0) {	/* it counts no pages now */
+		m->nwatches--;
+		memmove(m->watches + w, m->watches + w + 1,
+			(m->nwatches - w) * sizeof(watch_struct));
+	    }
+	    free(m->blocks);
+	    m->blocks = NULL;
+	}
+	return 0;
+    }
+    if (!on)
+	return 0;
+    m->blocks = malloc(sizeof(blockcache_struct));
+    if (m->blocks == NULL)
+	return -1;
+    memclr(m->blocks, sizeof(blockcache_struct));
+    return 0;
+#else
+    m->blocks = NULL;
+    return on ? -1 : 0;
+#endif
+}
+
+/* the bytes of memory at m->ram a snapshot keeps: the whole address
+   space with MMU, where the dirty pages are kept against it */
+static unsigned int
+snapsize(const machine_struct *m)
+{
+#ifdef MMU
+    return Z80MEMSIZE*1024;
+#else
+    return m->ramsize;
+#endif
+}
+
+/* copies the registers, memory, watches, breakpoints and callbacks of m
+   to s; the block cache is emptied so the watched pages in s are only
+   the ones of the watches. From then on the dirty pages of m are kept
+   against s, which must not change while m uses it. */
+void
+simz80_snapshot(machine_struct *m, snapshot_struct *s)
+{
+#ifdef BLOCKCACHE
+    if (m->blocks != NULL)
+	blockflush(m);
+#endif
+    memclr(m->dirtypage, sizeof(m->dirtypage));
+    m->dirtybase = s->ram;
+    s->state = *m;
+    memcpy(s->ram, m->ram, snapsize(m));
+}
+
+/* copies n bytes in chunks, writing only the ones that differ */
+static void
+copydiff(BYTE *dst, const BYTE *src, size_t n)
+{
+    size_t i, len;
+
+    for (i = 0; i < n; i += len) {
+	len = n - i < 64 ? n - i : 64;
+	if (memcmp(dst + i, src + i, len))
+	    memcpy(dst + i, src + i, len);
+    }
+}
+
+/* puts m back as it was in the snapshot s, writing only what changed
+   since: the dirty pages if s is the image they are kept against,
+   else the chunks that differ. Its memory, which must hold the RAM size
+   of s, block cache, counts and profile stay its own, and its dirty pages are
+   kept against s from then on. */
+void
+simz80_restore(machine_struct *m, const snapshot_struct *s)
+{
+    BYTE *ram = m->ram;
+    blockcache_struct *blocks = m->blocks;
+    unsigned long icount = m->icount;
+    unsigned long long tstates = m->tstates;
+    profile_struct *profile = m->profile;
+
+#ifdef BLOCKCACHE
+    if (blocks != NULL)
+	blockflush(m);
+#endif
+    if (m->dirtybase == s->ram)
+	resetdirty(m, s->ram);
+    else
+	copydiff(ram, s->ram, snapsize(&s->state));
+    /* the dirty pages are clear and kept against s in its state */
+    copydiff((BYTE *) m, (const BYTE *) &s->state, sizeof(machine_struct));
+    m->ram = ram;
+    m->blocks = blocks;
+    m->icount = icount;
+    m->tstates = tstates;
+    m->profile = profile;
+#ifndef MMU
+    remapmemory(m);
+#endif
+}
+
+/* a hash of the state of m mixed into h (64-bit FNV-1a): the registers
+   and the memory in the pages written since the last snapshot or
+   restore, the rest being as it was then. Two states with the same hash
+   can be taken for the same one, to find the machine in a loop. */
+unsigned long long
+simz80_hash(const machine_struct *m, unsigned long long h)
+{
+    WORD regs[16];
+    const BYTE *p;
+    unsigned int i, n, page;
+
+    regs[0] = m->af[0]; regs[1] = m->af[1]; regs[2] = m->af_sel;
+    regs[3] = m->regs[0].bc; regs[4] = m->regs[0].de; regs[5] = m->regs[0].hl;
+    regs[6] = m->regs[1].bc; regs[7] = m->regs[1].de; regs[8] = m->regs[1].hl;
+    regs[9] = m->regs_sel; regs[10] = m->ir; regs[11] = m->ix;
+    regs[12] = m->iy; regs[13] = m->sp; regs[14] = m->pc; regs[15] = m->IFF;
+    p = (const BYTE *) regs;
+    for (i = 0; i < sizeof(regs); i++)
+	h = (h ^ p[i]) * 0x100000001b3ULL;
+    for (page = 0; page < DIRTYPAGES; page++) {
+	if (!m->dirtypage[page])
+	    continue;
+#ifdef MMU
+	p = m->ram + (page<<DIRTYSHIFT);
+#else
+	p = m->rpage[page>>(MAPSHIFT-DIRTYSHIFT)] +
+	    ((page<<DIRTYSHIFT) & MAPMASK);
+#endif
+	h = (h ^ page) * 0x100000001b3ULL;
+	for (n = 0; n < 1<<DIRTYSHIFT; n++)
+	    h = (h ^ p[n]) * 0x100000001b3ULL;
+    }
+    return h;
 }
@@ -21,24 +21,105 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA. */
 
 /* SEE limits and BYTE-, WORD- and FASTREG - defintions im MEM_MMU.h */
 
-/* two sets of accumulator / flags */
-extern WORD af[2];
-extern int af_sel;
-
 /* two sets of 16-bit registers */
-extern struct ddregs {
+struct ddregs {
 	WORD bc;
 	WORD de;
 	WORD hl;
-} regs[2];
-extern int regs_sel;
-
-extern WORD ir;
-extern WORD ix;
-extern WORD iy;
-extern WORD sp;
-extern WORD pc;
-extern WORD IFF;
+};
+
+/* the stop set and the breakpoints are bitmaps with one bit per address */
+#define STOPMAPSIZE	(Z80MEMSIZE*1024/8)
+
+/* the ROM translated by mkromaot is below this address */
+#define AOTTOP		0x2000
+
+/* Straight runs of code executed from a branch target are recorded as
+   blocks of instruction handlers, so running them again does not decode
+   the opcodes or make the checks between instructions; see
+   simz80_blocks(). A block is looked up by its first address and is
+   dropped when its bytes are written. */
+#define BLOCKS		512	/* entries in the block cache, a power of two */
+#define BLOCKOPS	32	/* most instructions in a block */
+
+typedef struct {
+	WORD start;		/* address of the first instruction */
+	unsigned int end;	/* after the last byte it can use, above start */
+	int n;			/* instructions recorded */
+	int live;		/* the pages of start..end count it */
+	void *op[BLOCKOPS];	/* the handler of each instruction */
+} block_struct;
+
+typedef struct {
+	block_struct block[BLOCKS];
+	unsigned short codepage[WATCHPAGES];	/* live blocks in each watch page */
+	void *exit;		/* handler that leaves a dropped block */
+} blockcache_struct;
+
+/* Built with PROFILE, simz80_run() counts the opcodes it runs in a
+   profile, one table per prefix group, and what runs at each address;
+   see simz80.c. */
+#define OPS_MAIN	0	/* no prefix */
+#define OPS_CB		1
+#define OPS_ED		2
+#define OPS_DD		3
+#define OPS_FD		4
+#define OPS_DDCB	5
+#define OPS_FDCB	6
+#define OPGROUPS	7
+
+typedef struct {
+	unsigned long count[OPGROUPS][256];	/* instructions run by opcode */
+	unsigned long pccount[Z80MEMSIZE*1024];	/* instructions run at each address */
+	unsigned long long pctstates[Z80MEMSIZE*1024];	/* and their T-states */
+	unsigned long calls[Z80MEMSIZE*1024];	/* calls and restarts to each address */
+} profile_struct;
+
+/* one emulated machine: the Z80 registers, the memory it sees and its
+   I/O callbacks, so several machines can run in the same process */
+typedef struct machine_struct {
+	WORD af[2];		/* two sets of accumulator / flags */
+	int af_sel;
+	struct ddregs regs[2];
+	int regs_sel;
+	WORD ir;
+	WORD ix;
+	WORD iy;
+	WORD sp;
+	WORD pc;
+	WORD IFF;
+	BYTE *ram;		/* the RAM, ramsize bytes mapped at ramstart */
+#ifndef MMU
+	BYTE *rpage[MAPPAGES];	/* where each page is read, see mapmemory() */
+	BYTE *wpage[MAPPAGES];	/* and where it is written */
+	const BYTE *rom;	/* the map they come from */
+	unsigned int romsize;
+	unsigned int ramstart;
+	unsigned int ramsize;
+	BYTE sink[1 << MAPSHIFT];	/* the writes to ROM */
+#endif
+	BYTE watchpage[WATCHPAGES];	/* number of watches in each page */
+	BYTE dirtypage[DIRTYPAGES];	/* pages written, see mem_mmu.h */
+	const BYTE *dirtybase;	/* image the dirty pages differ from, or NULL */
+	watch_struct watches[MAXWATCHES];	/* see mem_mmu.h */
+	int nwatches;
+	BYTE breakmap[STOPMAPSIZE];	/* addresses with a breakpoint */
+	BYTE aotmap[AOTTOP/8];		/* translated code enabled, see simz80_aot() */
+	int (*breakhook)(struct machine_struct *m, WORD addr);
+	int (*in)(struct machine_struct *m, unsigned int port);
+	void (*out)(struct machine_struct *m, unsigned int port, unsigned char value);
+	blockcache_struct *blocks;	/* NULL unless simz80_blocks() enabled it */
+	void *user;		/* free for the callbacks */
+	unsigned long icount;	/* instructions executed by simz80_run() */
+	unsigned long long tstates;	/* and their T-states, with PROFILE */
+	profile_struct *profile;	/* opcodes counted with PROFILE, or NULL */
+} machine_struct;
+
+/* a copy of a machine to put it back to later, see simz80_snapshot() */
+typedef struct {
+	machine_struct state;
+	BYTE ram[Z80MEMSIZE*1024];	/* the first state.ramsize bytes */
+} snapshot_struct;
 
 /* see definitions for memory in mem_mmu.h */
 
@@ -46,7 +127,30 @@ extern WORD IFF;
 extern volatile int stopsim;
 #endif
 
-extern FASTWORK simz80(FASTREG PC);
+extern FASTWORK simz80(machine_struct *m);
+extern int simz80_run(machine_struct *m, const BYTE *stops, unsigned long budget);
+extern void simz80_aot(machine_struct *m);
+extern int simz80_blocks(machine_struct *m, int on);
+extern void simz80_snapshot(machine_struct *m, snapshot_struct *s);
+extern void simz80_restore(machine_struct *m, const snapshot_struct *s);
+extern unsigned long long simz80_hash(const machine_struct *m, unsigned long long h);
+
+/* reasons for simz80_run() to return, m->pc holds the next instruction */
+#define STOP_PC		0	/* pc is in the stop set */
+#define STOP_BUDGET	1	/* the instruction budget is exhausted */
+#define STOP_HOOK	2	/* a write watch asked to stop */
+#define STOP_HALT	3	/* a HALT instruction has been executed */
+#define STOP_BREAK	4	/* the breakpoint hook asked to stop */
+
+/* Breakpoints are set in the machine's breakmap and are only checked when
+   a jump, call, return or RST lands on them, so they cost nothing to
+   straight-line code. breakhook is then called with the registers saved
+   in the machine; it can change them (to skip a ROM routine, say) and
+   returns non-zero to make simz80_run() return. */
+
+#define SETSTOP(m, a)	((m)[((a)&0xffff)>>3] |= 1 << ((a)&7))
+#define CLRSTOP(m, a)	((m)[((a)&0xffff)>>3] &= ~(1 << ((a)&7)))
+#define TSTSTOP(m, a)	(((m)[((a)&0xffff)>>3] >> ((a)&7)) & 1)
 
 #define FLAG_C	1
 #define FLAG_N	2
@@ -71,10 +175,8 @@ extern FASTWORK simz80(FASTREG PC);
 */
 
 #ifndef BIOS
-extern int in(unsigned int);
-extern void out(unsigned int, unsigned char);
-#define Input(port) in(port)
-#define Output(port, value) out(port,value)
+#define Input(port) m->in(m, port)
+#define Output(port, value) m->out(m, port, value)
 #else
 /* Define these as macros or functions if you really want to simulate I/O */
 #define Input(port)	0
@@ -19,12 +19,23 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
 #include "mem_mmu.h"
 #include "simz80.h"
 #include "zx81rom.h"
-#include "xltables.h"
+#include "xltokens.h"
+#include "stats.h"
+#include "sink.h"
+#include "zx81list.h"
+#ifdef PROFILE
+#include "zx81sym.h"
+#endif
 
 // some zx-81 system variables
 #define ERR_NR 0x4000
@@ -36,40 +47,151 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define E_PPC  0x400a
 #define D_FILE 0x400c
 #define DF_CC  0x400e
+#define VARS   0x4010
+#define E_LINE 0x4014
+#define CH_ADD 0x4016
+#define STKBOT 0x401a
+#define STKEND 0x401c
+#define MEM    0x401f
+#define DF_SZ  0x4022
+#define LAST_K 0x4025
+#define MARGIN 0x4028
 #define NXTLIN 0x4029
+#define FRAMES 0x4034
 #define S_POSN 0x4039
 #define PRBUFF 0x403c
 
-// globals used by the simulator
-WORD af[2];
-int af_sel;
+// some zx-81 rom routines
+#define ERROR_2  0x0056 // reports the error in the byte after an RST 08
+#define ERROR_3  0x0058 // reports the error in L, jumped to by some routines
+#define ENTER_CH 0x0808 // prints the character in A to the display file
+#define STOP     0x0cdc // the STOP command
+#define KEY_WAIT 0x04c1 // waits for a key after printing a report
 
-struct ddregs regs[2];
-int regs_sel;
+// how a listing ends
+#define LIST_DONE    0 // the STOP command has been reached
+#define LIST_BUDGET  1 // the instruction budget has run out
+#define LIST_TIMEOUT 2 // the time limit has been reached
+#define LIST_LOOP    3 // the machine is in an endless loop that outputs nothing
+#define LIST_REPORT  4 // the ROM has stopped with an error report
 
-WORD ir;
-WORD ix;
-WORD iy;
-WORD sp;
-WORD pc;
-WORD IFF;
+// instructions run between checks of the limits
+#define SLICE 1000000UL
+// instructions run looking for the loop anchor before taking another one
+#define SEEK  10000UL
+// states kept to find a loop
+#define LOOP_STATES 16
+
+// listing options
+typedef struct
+{
+  int show_cursor;
+  const xltoken_t* table;
+  int width;
+  int start;
+  int full;
+  int trap;
+  int hybrid; // list the lines that need no proof natively
+  int lines; // lines to list before stopping, 0 for all
+  int ranges; // parts a single listing is split into, listed in parallel
+  int threads; // workers listing the parts, or the inputs of a batch
+  int ram_size; // in KB
+  unsigned long budget; // instructions per listing, 0 for no limit
+  double timeout; // seconds per listing, 0 for no limit
+  const char* profile_name; // where to write the ROM profile, NULL for none
+} options_t;
+
+// state of a listing shared with the simulation hooks
+typedef struct
+{
+  sink_t* output;
+  const options_t* options;
+  int column; // column counter
+  unsigned long count; // characters and new lines output
+  int lines; // lines listed, ended by a 0x76
+  stats_t* stats; // where the lines and characters output are counted
+} listing_t;
+
+// A machine that comes back to the same state with nothing output in
+// between will go round forever. Once per slice the state is hashed where
+// the run reaches the anchor address, so the states compared are at the
+// same point of a loop, wherever the slice ended.
+typedef struct
+{
+  BYTE stops[STOPMAPSIZE]; // the anchor
+  int anchor;              // -1 until the first slice ends
+  unsigned long seek;      // instructions run when the search for the anchor gives up, 0 when not searching
+  unsigned long long state[LOOP_STATES]; // hashes taken at the anchor
+  int count;
+} loop_t;
+
+// one input file of a batch
+typedef struct
+{
+  const char* input_name;
+  char* text;   // listing, when writing to a combined stream
+  size_t size;  // size of the listing
+  int result;   // a LIST_ value, or -1 on errors
+  int done;     // set when the worker is done with the input
+  stats_t stats;
+} job_t;
+
+// a part of a single listing, listed by a worker thread on its own machine
+typedef struct
+{
+  const snapshot_struct* loaded; // the machine with the program loaded
+  options_t options; // with the first line of the part and its number of lines
+  char* text;   // listing of the part
+  size_t size;  // size of the listing
+  int result;   // a LIST_ value, or -1 on errors
+  stats_t stats;
+} range_t;
+
+// the parts of a single listing shared by the worker threads
+typedef struct
+{
+  range_t* ranges;
+  int count;
+  int next;               // next part to be taken by a worker
+  pthread_mutex_t mutex;
+} parts_t;
+
+// a batch of input files shared by the worker threads
+typedef struct
+{
+  const options_t* options;
+  const snapshot_struct* loaded; // the machine before reading a program
+  const char* output_dir; // NULL for a combined stream
+  job_t* jobs;
+  int count;
+  int next;               // next job to be taken by a worker
+  pthread_mutex_t mutex;
+  pthread_cond_t done;    // signaled when a job is done
+  profile_struct* profile; // the profiles of the workers added up, NULL if not profiling
+} batch_t;
 
 // dummy input/output callbacks
-int in(unsigned int port)
+static int in(machine_struct* m, unsigned int port)
 {
   // return 0xff so no spurious key presses
   return 0xff;
 }
 
-void out(unsigned int port, unsigned char value)
+static void out(machine_struct* m, unsigned int port, unsigned char value)
+{
+}
+
+// write watch that makes the simulation return to the lister
+static int stop_hook(machine_struct* m, WORD addr, BYTE value)
 {
+  return 1;
 }
 
 static void usage(FILE* out)
 {
   fprintf(out, "WMAPLIST - World's Most Accurate P LIST program.\n\n");
   fprintf(out, "Copyright (C) 2010 Andre de Leiradella. Released under the GPL.\n\n");
-  fprintf(out, "Usage: wmaplist [-h] [-c] [-z] [-w width] [-s n] [-f] [-a] [-o output] input.p\n\n");
+  fprintf(out, "Usage: wmaplist [-h] [-c] [-z] [-w width] [-s n] [-f] [-a] [-t] [-n] [-r n] [-m kb] [-i n] [-k s] [-p profile] [-o output] [-d dir] [-j n] [-l] [-b n] [--stats] input.p...\n\n");
   fprintf(out, "-h    Show this help screen\n");
   fprintf(out, "-c    Show the current line cursor (toggle, default: no)\n");
   fprintf(out, "-z    Use the ZX-81.TTF font (toggle, default: no)\n");
@@ -77,19 +199,104 @@ static void usage(FILE* out)
   fprintf(out, "-s    Set the first line to list (default: 0)\n");
   fprintf(out, "-f    Don't stop the listing on spurious program endings (toggle, default: no)\n");
   fprintf(out, "-a    Accurate (turns -c and -z on, -w to 32 and -f off (default: no)\n");
-  fprintf(out, "-o    Output listing to file \"output\" (default: stdout)\n\n");
+  fprintf(out, "-t    Take characters at the ROM's ENTER-CH, skipping the display file (toggle, default: no)\n");
+  fprintf(out, "-n    List the lines a ZX-81 would have made without the emulator, which lists\n");
+  fprintf(out, "      the others, or all of them with -i (toggle, default: no)\n");
+  fprintf(out, "-r    Split a single listing into n parts listed in parallel, unless -i or -k\n");
+  fprintf(out, "      is given (default: 1)\n");
+  fprintf(out, "-m    RAM size in KB: 1, 2, 16, 32 or 48 (default: 48)\n");
+  fprintf(out, "-i    Stop each listing after n instructions (default: no limit)\n");
+  fprintf(out, "-k    Stop each listing after s seconds (default: no limit)\n");
+  fprintf(out, "-p    Write the instructions and T-states run in each ROM routine to \"profile\"\n");
+  fprintf(out, "      (wmaplist-profile only)\n");
+  fprintf(out, "-o    Output listing to file \"output\" (default: stdout)\n");
+  fprintf(out, "-d    Output each listing to \"dir/input.txt\" instead of \"output\"\n");
+  fprintf(out, "-j    Number of worker threads, for the inputs or the parts of -r\n");
+  fprintf(out, "      (default: number of processors)\n");
+  fprintf(out, "-l    Read the names of more input files from stdin\n");
+  fprintf(out, "-b    Benchmark: list a built-in program n times and report the emulated MIPS\n");
+  fprintf(out, "--stats Print the times of each phase and the amounts read and output to stderr\n\n");
+  fprintf(out, "Inputs can be P files or directories, in which case all the P files in\n");
+  fprintf(out, "them are listed. Several listings written to \"output\" keep the input order.\n\n");
+  fprintf(out, "A listing stopped by -i or -k, because the program is in an endless loop\n");
+  fprintf(out, "that outputs nothing, or because the ROM stops with an error report, keeps\n");
+  fprintf(out, "what was output so far, and the exit status is then 2 unless there were\n");
+  fprintf(out, "errors.\n\n");
+}
+
+static void output_newline(listing_t* listing)
+{
+  sink_putc(listing->output, '\n');
+  listing->count++;
+  listing->stats->lines++;
+  listing->stats->chars++;
+}
+
+static void output_char(listing_t* listing, int ch)
+{
+  // check available space in line
+  if (++listing->column == listing->options->width)
+  {
+    output_newline(listing);
+    listing->column = 0;
+  }
+  // output it
+  const xltoken_t* token = listing->options->table + ch;
+  sink_write(listing->output, token->text, token->size);
+  listing->stats->chars += token->size;
+  listing->count++;
+}
+
+// breakpoint hook, stops at STOP, at errors and at the wait for a key after
+// a report, and takes the characters at ENTER-CH
+static int break_hook(machine_struct* m, WORD addr)
+{
+  if (addr != ENTER_CH)
+  {
+    return 1;
+  }
+  // the character to print is in A
+  listing_t* listing = (listing_t*)m->user;
+  int ch = hreg(m->af[m->af_sel]);
+  if (ch == 0x76)
+  {
+    // a new line, which also sets the leading space suppression in FLAGS
+    output_newline(listing);
+    listing->column = -1;
+    RAMBYTE(m, FLAGS) |= 1;
+    // a listing of some lines stops after the last one
+    if (++listing->lines == listing->options->lines)
+    {
+      return 1;
+    }
+  }
+  else
+  {
+    // ENTER-CH loads S_POSN into BC before writing the character
+    output_char(listing, ch);
+    m->regs[m->regs_sel].bc = RAMBYTE(m, S_POSN) | RAMBYTE(m, S_POSN + 1) << 8;
+  }
+  // ENTER-CH leaves the character in A and D
+  Sethreg(m->regs[m->regs_sel].de, ch);
+  // return to PRINT-SP
+  m->pc = RAMBYTE(m, m->sp) | RAMBYTE(m, (m->sp + 1) & 0xffff) << 8;
+  m->sp += 2;
+  return 0;
 }
 
-static void setup_simulation()
+// the ROM with DISPLAY-5 patched to a no-op, shared by all the machines
+static BYTE patched_rom[8192];
+
+static void setup_simulation(machine_struct* m, int ram_size)
 {
-  // load ROM with ghosting
-  memcpy(ram, rom, 8192);
-  memcpy(ram + 8192, rom, 8192);
-  // patch DISPLAY-5 to a no-op in ROM
-  ram[0x02b5] = 0xc9;
-  ram[0x02b5 + 8192] = 0xc9;
-  // zero rest of RAM
-  memset(ram + 0x4000, 0, 0xc000);
+  // map the ROM read-only with ghosting, and the RAM repeated over the rest
+  memcpy(patched_rom, rom, 8192);
+  patched_rom[0x02b5] = 0xc9;
+  mapmemory(m, patched_rom, 8192, 0x4000, ram_size * 1024);
+  // zero the RAM
+  memset(m->ram, 0, m->ramsize);
+  // RAMTOP is at the end of the RAM, up to 16K
+  int ramtop = 0x4000 + (ram_size < 16 ? ram_size : 16) * 1024;
 
   // put stack values in place
   static const BYTE stack[] =
@@ -100,141 +307,67 @@ static void setup_simulation()
     /*3FE0:*/ 0x27, 0x1A, 0xC8, 0x0E, 0xF3, 0x19, 0xCF, 0x0E, 0xCB, 0x0E, 0xF3, 0x19, 0x01, 0x40, 0xBC, 0x43, 
     /*3FF0:*/ 0xC7, 0x12, 0x81, 0x02, 0x3B, 0x40, 0xFF, 0xFF, 0x80, 0x00, 0x85, 0x01, 0x76, 0x06, 0x00, 0x3E, 
   };
-  memcpy(ram + 0x8000 - sizeof(stack), stack, sizeof(stack));
+  memcpy(&RAMBYTE(m, ramtop - sizeof(stack)), stack, sizeof(stack));
 	
   // setup the registers
-  regs[0].bc = 0x0080;
-  regs[0].de = 0xffff;
-  regs[0].hl = 0x403b;
-  af[0]      = 0x0185;
+  m->regs[0].bc = 0x0080;
+  m->regs[0].de = 0xffff;
+  m->regs[0].hl = 0x403b;
+  m->af[0]      = 0x0185;
   
-  regs[1].bc = 0x8102;
-  regs[1].de = 0x002b;
-  regs[1].hl = 0x0000;
-  af[1]      = 0xca89;
+  m->regs[1].bc = 0x8102;
+  m->regs[1].de = 0x002b;
+  m->regs[1].hl = 0x0000;
+  m->af[1]      = 0xca89;
   
-  ix = 0x0281;
-  iy = 0x4000;
-  ir = 0x1edf;
-  sp = 0x7ffe;
-  pc = 0x0676;
+  m->ix = 0x0281;
+  m->iy = 0x4000;
+  m->ir = 0x1edf;
+  m->sp = ramtop - 2;
+  m->pc = 0x0676;
   
-  IFF = 0;
-  af_sel = regs_sel = 0;
+  m->IFF = 0;
+  m->af_sel = m->regs_sel = 0;
+  
+  // no writes are watched, no breakpoints and the i/o ports do nothing
+  clearwatches(m);
+  memset(m->breakmap, 0, sizeof(m->breakmap));
+  // run the translated ROM code, except where it has been patched
+  simz80_aot(m);
+  m->breakhook = break_hook;
+  m->in = in;
+  m->out = out;
   
   // setup system vars that are not saved in the P file
-  ram[ERR_NR    ] = 0xff;
-  ram[FLAGS     ] = 0x80;
-  ram[ERR_SP    ] = 0xfc;
-  ram[ERR_SP + 1] = 0x7f;
-  ram[RAMTOP    ] = 0x00;
-  ram[RAMTOP + 1] = 0x80;
-  ram[MODE      ] = 0x00;
-  ram[PPC       ] = 0xfe;
-  ram[PPC    + 1] = 0xff;
+  RAMBYTE(m, ERR_NR    ) = 0xff;
+  RAMBYTE(m, FLAGS     ) = 0x80;
+  RAMBYTE(m, ERR_SP    ) = (ramtop - 4) & 0xff;
+  RAMBYTE(m, ERR_SP + 1) = (ramtop - 4) >> 8;
+  RAMBYTE(m, RAMTOP    ) = ramtop & 0xff;
+  RAMBYTE(m, RAMTOP + 1) = ramtop >> 8;
+  RAMBYTE(m, MODE      ) = 0x00;
+  RAMBYTE(m, PPC       ) = 0xfe;
+  RAMBYTE(m, PPC    + 1) = 0xff;
 
   // now the state is a copy of a zx81 at the very ending of a LOAD command
 }
 
-int main(int argc, const char* argv[])
+// returns the number of bytes read, or -1 on errors
+static long load_program(machine_struct* m, const snapshot_struct* loaded, const char* input_name)
 {
-  // check execution without arguments
-  if (argc < 2)
-  {
-    usage(stderr);
-    return -1;
-  }
-  
-  // configuration variables
-  int show_cursor = 0;
-  const char** table = table_ascii;
-  const char* output_name = "<stdout>";
-  FILE* output = stdout;
-  const char* input_name = NULL;
-  int width = 32;
-  int start = 0;
-  int full = 0;
-  
-  // process command line arguments
-  int i;
-  for (i = 1; i < argc; i++)
-  {
-    if (!strcmp(argv[i], "-c"))
-    {
-      show_cursor = !show_cursor;
-    }
-    else if (!strcmp(argv[i], "-z"))
-    {
-      table = table == table_ascii ? table_zx81 : table_ascii;
-    }
-    else if (!strcmp(argv[i], "-w"))
-    {
-      if ((i + 1) >= argc)
-      {
-        fprintf(stderr, "Missing argument to -w\n");
-        return -1;
-      }
-      width = atoi(argv[++i]);
-    }
-    else if (!strcmp(argv[i], "-a"))
-    {
-      show_cursor = 1;
-      table = table_zx81;
-      width = 32;
-      full = 0;
-    }
-    else if (!strcmp(argv[i], "-s"))
-    {
-      if ((i + 1) >= argc)
-      {
-        fprintf(stderr, "Missing argument to -s\n");
-        return -1;
-      }
-      start = atoi(argv[++i]);
-      if (start < 0 || start > 9999)
-      {
-        fprintf(stderr, "Invalid argument to -s, line must be between 0 and 9999\n");
-        return -1;
-      }
-    }
-    else if (!strcmp(argv[i], "-f"))
-    {
-      full = !full;
-    }
-    else if (!strcmp(argv[i], "-o"))
-    {
-      if ((i + 1) >= argc)
-      {
-        fprintf(stderr, "Missing argument to -o\n");
-        return -1;
-      }
-      output_name = argv[++i];
-    }
-    else if (argv[i][0] != '-')
-    {
-      input_name = argv[i];
-    }
-    else if (!strcmp(argv[i], "-h"))
-    {
-      usage(stdout);
-      return 0;
-    }
-    else
-    {
-      fprintf(stderr, "Unknown option: %s\n", argv[i]);
-      return -1;
-    }
-  }
-
   // load input file
-  setup_simulation();
+  simz80_restore(m, loaded);
   FILE* input = fopen(input_name, "rb");
   if (input == NULL)
   {
     fprintf(stderr, "Error opening input file: %s\n", strerror(errno));
     return -1;
   }
-  fread(ram + 0x4009, 1, 65536 - 0x4009, input);
+  size_t size = fread(&RAMBYTE(m, 0x4009), 1, m->ramstart + m->ramsize - 0x4009, input);
+  if (size != 0)
+  {
+    markdirty(m, 0x4009, 0x4009 + size - 1);
+  }
   if (ferror(input))
   {
     fprintf(stderr, "Error reading input file: %s\n", strerror(errno));
@@ -242,60 +375,120 @@ int main(int argc, const char* argv[])
     return -1;
   }
   fclose(input);
-  
-  // setup output file
-  if (strcmp(output_name, "<stdout>"))
+  return size;
+}
+
+static const char* list_result(int result)
+{
+  switch (result)
   {
-    output = fopen(output_name, "wb");
-    if (output == NULL)
+    case LIST_BUDGET:
+      return "instruction budget exhausted";
+    case LIST_TIMEOUT:
+      return "time limit reached";
+    case LIST_REPORT:
+      return "error report";
+    default:
+      return "endless loop";
+  }
+}
+
+// hashes the state of the machine with the amount of output, returns 1 if
+// it has been seen at the anchor before
+static int loop_seen(loop_t* loop, machine_struct* m, unsigned long count)
+{
+  // FRAMES counts down for as long as the ROM waits for a key, which never
+  // comes, and only times PAUSE, so it is left out of the state
+  BYTE frames[2] = { RAMBYTE(m, FRAMES), RAMBYTE(m, FRAMES + 1) };
+  RAMBYTE(m, FRAMES) = RAMBYTE(m, FRAMES + 1) = 0;
+  unsigned long long state = simz80_hash(m, 14695981039346656037ULL ^ count);
+  RAMBYTE(m, FRAMES    ) = frames[0];
+  RAMBYTE(m, FRAMES + 1) = frames[1];
+  int i;
+  for (i = 0; i < loop->count && i < LOOP_STATES; i++)
+  {
+    if (loop->state[i] == state)
     {
-      fprintf(stderr, "Error opening output file: %s\n", strerror(errno));
-      return -1;
+      return 1;
     }
   }
+  loop->state[loop->count++ % LOOP_STATES] = state;
+  return 0;
+}
+
+// anchors the search for loops where the machine is now
+static void loop_anchor(loop_t* loop, machine_struct* m, unsigned long count)
+{
+  if (loop->anchor >= 0)
+  {
+    CLRSTOP(loop->stops, loop->anchor);
+  }
+  loop->anchor = m->pc;
+  SETSTOP(loop->stops, loop->anchor);
+  loop->seek = 0;
+  loop->count = 0;
+  loop_seen(loop, m, count);
+}
+
+// lists the loaded program, returns a LIST_ value
+static int list_program(machine_struct* m, const options_t* options, sink_t* output, stats_t* stats)
+{
+  int i;
   
   // if full list was required, we have to tweak the program to remove spurious program endings (0x76 0x76)
-  if (full)
+  if (options->full)
   {
     int current = 0x407d; // address of first line
     int target = current; // target position
-    while (ram[current] != 0x76)
+    // the walk ends at the top of memory, where RAMBYTE would go round, and
+    // so does the target, which lines that go back make grow
+    while (current < 0x10000 && target < 0x10000 && RAMBYTE(m, current) != 0x76)
     {
       // evaluate the next line
-      int next_line = current + (ram[current + 2] | ram[current + 3] << 8) + 4;
+      int next_line = current + (RAMBYTE(m, current + 2) | RAMBYTE(m, current + 3) << 8) + 4;
       // copy the line number and the line length to target
-      for (i = 0; i < 4; i++)
+      for (i = 0; i < 4 && target < 0x10000; i++)
       {
-        ram[target++] = ram[current++];
+        RAMBYTE(m, target++) = RAMBYTE(m, current++);
       }
       // repeat until the end of the line
-      while (ram[current] != 0x76)
+      while (current < 0x10000 && target < 0x10000 && RAMBYTE(m, current) != 0x76)
       {
         // 0x7e marks the start of floating-point constants
-        if (ram[current] == 0x7e)
+        if (RAMBYTE(m, current) == 0x7e)
         {
           // we skip it because the literal value to list follows the constant
-          for (i = 0; i < 6; i++)
+          for (i = 0; i < 6 && target < 0x10000; i++)
           {
-            ram[target++] = ram[current++];
+            RAMBYTE(m, target++) = RAMBYTE(m, current++);
           }
         }
         else
         {
-          ram[target++] = ram[current++];
+          RAMBYTE(m, target++) = RAMBYTE(m, current++);
         }
       }
+      if (current >= 0x10000 || target >= 0x10000)
+      {
+        break;
+      }
       // copy the end of line
-      ram[target++] = ram[current++];
+      RAMBYTE(m, target++) = RAMBYTE(m, current++);
       // check for spurious line endings
-      if (ram[current] == 0x76 && current != next_line)
+      if (current < 0x10000 && RAMBYTE(m, current) == 0x76 && current != next_line)
       {
         // jump to the next line so that we overwrite the spurious line ending
         current = next_line;
       }
     }
+    if (current >= 0x10000 || target >= 0x10000)
+    {
+      fprintf(stderr, "Malformed program: no program ending before the top of memory\n");
+      return -1;
+    }
     // add the program ending
-    ram[target] = 0x76;
+    RAMBYTE(m, target) = 0x76;
+    markdirty(m, 0x407d, target);
   }
   
   // put a BASIC program into the printer buffer and make the BIOS resume to it after the load
@@ -307,71 +500,1478 @@ int main(int argc, const char* argv[])
     /*4080:*/ 0x00, 0xF0, 0xC5, 0x0B, 0x1C, 0x1C, 0x1C, 0x1C, 0x0B, 0x76, 0x00, 0x02, 0x02, 0x00, 0xE3, 0x76, 
     /*4090:*/ 0x76, 
   };
-  memcpy(ram + PRBUFF, program, sizeof(program));
+  memcpy(&RAMBYTE(m, PRBUFF), program, sizeof(program));
+  // the system variables are written below too, and by the hooks
+  markdirty(m, ERR_NR, PRBUFF + sizeof(program) - 1);
   // tell BIOS to resume running on out program
-  ram[NXTLIN    ] = PRBUFF & 0xff;
-  ram[NXTLIN + 1] = PRBUFF >> 8;
+  RAMBYTE(m, NXTLIN    ) = PRBUFF & 0xff;
+  RAMBYTE(m, NXTLIN + 1) = PRBUFF >> 8;
   
   // override starting line number
   char line_number[5];
-  snprintf(line_number, sizeof(line_number), "%.4d", start);
-  ram[PRBUFF +  7] = 0x1c + line_number[0] - '0';
-  ram[PRBUFF +  8] = 0x1c + line_number[1] - '0';
-  ram[PRBUFF +  9] = 0x1c + line_number[2] - '0';
-  ram[PRBUFF + 10] = 0x1c + line_number[3] - '0';
+  snprintf(line_number, sizeof(line_number), "%.4d", options->start);
+  RAMBYTE(m, PRBUFF +  7) = 0x1c + line_number[0] - '0';
+  RAMBYTE(m, PRBUFF +  8) = 0x1c + line_number[1] - '0';
+  RAMBYTE(m, PRBUFF +  9) = 0x1c + line_number[2] - '0';
+  RAMBYTE(m, PRBUFF + 10) = 0x1c + line_number[3] - '0';
   
   // save the E_PPC to show/hide the cursor
-  int e_ppc = show_cursor ? ram[E_PPC] | ram[E_PPC + 1] << 8 : 65535;
+  int e_ppc = options->show_cursor ? RAMBYTE(m, E_PPC) | RAMBYTE(m, E_PPC + 1) << 8 : 65535;
   
   // resume simulation!
-  ram[S_POSN    ] = 33; // 33 columns available in line (includes the new line)
-  ram[S_POSN + 1] = 24; // 24 lines available in the screen
-  int column = -1;      // column counter
-  FASTREG PC = pc;      // the z80 program counter
-  while (PC != 0x0cdc) // run util STOP command called
+  RAMBYTE(m, S_POSN    ) = 33; // 33 columns available in line (includes the new line)
+  RAMBYTE(m, S_POSN + 1) = 24; // 24 lines available in the screen
+  FASTREG PC = m->pc;   // the z80 program counter
+  listing_t listing;
+  listing.output = output;
+  listing.options = options;
+  listing.column = -1;
+  listing.count = 0;
+  listing.lines = 0;
+  listing.stats = stats;
+  m->user = &listing;
+  // the simulation stops at the STOP command, and at an error before its
+  // report is printed, which -t would take as listed, or where the ROM
+  // waits for a key that never comes after a report, and ENTER-CH is
+  // trapped if asked
+  SETSTOP(m->breakmap, STOP);
+  SETSTOP(m->breakmap, ERROR_2);
+  SETSTOP(m->breakmap, ERROR_3);
+  SETSTOP(m->breakmap, KEY_WAIT);
+  if (options->trap)
+  {
+    SETSTOP(m->breakmap, ENTER_CH);
+  }
+  // writes to the system variables we take care of make the simulation return to us
+  addwatch(m, E_PPC, DF_CC + 1, stop_hook);
+  addwatch(m, S_POSN, S_POSN + 1, stop_hook);
+  // the limits are checked between slices of the run
+  unsigned long first = m->icount;
+  unsigned long checked = 0; // instructions run when the time was last checked
+  loop_t loop;
+  memset(loop.stops, 0, sizeof(loop.stops));
+  loop.anchor = -1;
+  loop.seek = 0;
+  double deadline = options->timeout > 0 ? now() + options->timeout : 0;
+  while (PC != STOP && PC != ERROR_2 && PC != ERROR_3 && PC != KEY_WAIT) // run util STOP command called
 	{
     // Overwrite E_PPC to show/hide the cursor
-    ram[E_PPC    ] = e_ppc & 0xff;
-    ram[E_PPC + 1] = e_ppc >> 8;
+    RAMBYTE(m, E_PPC    ) = e_ppc & 0xff;
+    RAMBYTE(m, E_PPC + 1) = e_ppc >> 8;
     // get the address of the first character in the screen
-    int d_file = ram[D_FILE] | ram[D_FILE + 1] << 8;
+    int d_file = RAMBYTE(m, D_FILE) | RAMBYTE(m, D_FILE + 1) << 8;
     d_file++;
     // hack the print position to the first character in the screen
-    ram[DF_CC    ] = d_file & 0xff;
-    ram[DF_CC + 1] = d_file >> 8;
+    RAMBYTE(m, DF_CC    ) = d_file & 0xff;
+    RAMBYTE(m, DF_CC + 1) = d_file >> 8;
     // if a character has been printed...
-    if (ram[S_POSN] != 33)
+    if (RAMBYTE(m, S_POSN) != 33)
     {
-      // check available space in line
-      if (++column == width)
-      {
-        fprintf(output, "\n");
-        column = 0;
-      }
       // output it
-      fprintf(output, "%s", table[ram[d_file]]);
+      output_char(&listing, RAMBYTE(m, d_file));
       // and make 33 columns available again
-      ram[S_POSN] = 33;
+      RAMBYTE(m, S_POSN) = 33;
     }
     // if a new line has begun...
-    if (ram[S_POSN + 1] != 24)
+    if (RAMBYTE(m, S_POSN + 1) != 24)
     {
       // we output a new line
-      fprintf(output, "\n");
+      output_newline(&listing);
       // zero the column counter
-      column = -1;
+      listing.column = -1;
       // and make 33 columns and 24 lines available again
-      ram[S_POSN    ] = 33;
-      ram[S_POSN + 1] = 24;
+      RAMBYTE(m, S_POSN    ) = 33;
+      RAMBYTE(m, S_POSN + 1) = 24;
+      listing.lines++;
+    }
+    // a listing of some lines stops after the last one
+    if (options->lines != 0 && listing.lines == options->lines)
+    {
+      return LIST_DONE;
+    }
+    // executes z80 instructions until a system variable is written or STOP is reached,
+    // in slices that end where the limits have to be checked
+    int reason;
+    do
+    {
+      unsigned long used = m->icount - first;
+      if (options->budget != 0 && used >= options->budget)
+      {
+        return LIST_BUDGET;
+      }
+      if (used - checked >= SLICE)
+      {
+        if (deadline != 0 && now() >= deadline)
+        {
+          return LIST_TIMEOUT;
+        }
+        checked = used;
+        // stop at the anchor to compare the state there
+        if (loop.anchor < 0)
+        {
+          loop_anchor(&loop, m, listing.count);
+        }
+        else
+        {
+          loop.seek = used + SEEK;
+        }
+      }
+      if (loop.seek != 0 && used >= loop.seek)
+      {
+        // the anchor is not in the code running now
+        loop_anchor(&loop, m, listing.count);
+      }
+      unsigned long slice = checked + SLICE - used;
+      if (options->budget != 0 && options->budget - used < slice)
+      {
+        slice = options->budget - used;
+      }
+      if (loop.seek != 0 && loop.seek - used < slice)
+      {
+        slice = loop.seek - used;
+      }
+      reason = simz80_run(m, loop.seek != 0 ? loop.stops : NULL, slice);
+      if (reason == STOP_PC)
+      {
+        loop.seek = 0;
+        if (loop_seen(&loop, m, listing.count))
+        {
+          return LIST_LOOP;
+        }
+      }
     }
-    // executes one z80 instruction
-		PC = simz80(PC) & 0xffff;
+    while (reason == STOP_BUDGET || reason == STOP_PC);
+    PC = m->pc;
 	}
-  
-  // all done, close output file and exit
-  if (output != stdout)
+  return PC == STOP ? LIST_DONE : LIST_REPORT;
+}
+
+// the lowest address LIST writes to, where the native lister can't know
+// what the ROM reads: the display file after its first byte, which ends
+// the program, the work space and the calculator stack of VAL, and the
+// machine stack below RAMTOP
+static unsigned list_limit(const unsigned char* memory)
+{
+  static const int pointers[] = { D_FILE, E_LINE, STKBOT };
+  unsigned limit = (memory[RAMTOP] | memory[RAMTOP + 1] << 8) - 256;
+  int i;
+  for (i = 0; i < 3; i++)
   {
-    fclose(output);
+    unsigned address = (memory[pointers[i]] | memory[pointers[i] + 1] << 8) + (pointers[i] == D_FILE);
+    if (address < limit)
+    {
+      limit = address;
+    }
   }
-  return 0;
+  return limit;
+}
+
+// returns 1 if -s lists the line at line first, as LINE-ADDR finds it
+// with its number
+static int list_reachable(const unsigned char* memory, unsigned line)
+{
+  int number = memory[line] << 8 | memory[line + 1];
+  return number <= 9999 && rom_list_addr(memory, number) == line;
+}
+
+// lists the loaded program with the native lister of zx81list.h, and
+// emulates the lines the native lister can't be trusted with, each run of
+// them listed alone from its first line as -s does, so the output is the
+// same as list_program's. A listing that reaches the memory LIST writes
+// to, or has a run -s can't get to, and the smaller machines, whose
+// memory repeats, are emulated whole. Returns a LIST_ value, or -1 on
+// errors.
+static int list_hybrid(machine_struct* m, const options_t* options, sink_t* output, stats_t* stats)
+{
+  // an instruction budget is spent by the whole listing in the emulator,
+  // and stops it where only list_program can
+  if (m->ramsize != 48 * 1024 || options->budget != 0)
+  {
+    return list_program(m, options, output, stats);
+  }
+  // the memory the ROM sees, with the spurious program endings taken out
+  // for full listings as list_program does
+  unsigned char* memory = (unsigned char*)malloc(65536);
+  if (memory == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return -1;
+  }
+  memcpy(memory + 0x4000, m->ram, m->ramsize);
+  // a program without an ending is left to list_program to report
+  unsigned limit = options->full && rom_list_full(memory) != 0 ? 0 : list_limit(memory);
+
+  // look for the lines to emulate, or what makes the whole program so
+  int risky = 0;
+  int run = 0; // risky lines in a row
+  unsigned line = rom_list_addr(memory, options->start);
+  while (line < limit && memory[line] < 0x40)
+  {
+    unsigned end = rom_list_end(memory, line);
+    if (end > limit)
+    {
+      break;
+    }
+    run = rom_list_risky(memory, line) ? run + 1 : 0;
+    if (run == 1 && !list_reachable(memory, line))
+    {
+      break;
+    }
+    risky += run != 0;
+    line = end;
+  }
+  if (line >= limit || memory[line] < 0x40)
+  {
+    free(memory);
+    return list_program(m, options, output, stats);
+  }
+
+  // the emulated lines start from the machine as it was loaded
+  snapshot_struct* loaded = NULL;
+  if (risky != 0)
+  {
+    loaded = (snapshot_struct*)malloc(sizeof(snapshot_struct));
+    if (loaded == NULL)
+    {
+      fprintf(stderr, "Out of memory\n");
+      free(memory);
+      return -1;
+    }
+    simz80_snapshot(m, loaded);
+  }
+  options_t alone = *options;
+  int cursor = options->show_cursor ? memory[E_PPC] | memory[E_PPC + 1] << 8 : -1;
+  rom_list_t list;
+  rom_list_init(&list, memory, options->table, options->width, cursor, output, stats);
+  // the time limit is for the whole listing, shared by the emulated runs
+  double deadline = options->timeout > 0 ? now() + options->timeout : 0;
+  int result = LIST_DONE;
+  line = rom_list_addr(memory, options->start);
+  while (result == LIST_DONE && memory[line] < 0x40)
+  {
+    if (rom_list_risky(memory, line))
+    {
+      if (deadline != 0)
+      {
+        alone.timeout = deadline - now();
+        if (alone.timeout <= 0)
+        {
+          result = LIST_TIMEOUT;
+          break;
+        }
+      }
+      alone.start = memory[line] << 8 | memory[line + 1];
+      alone.lines = 0;
+      do
+      {
+        alone.lines++;
+        line = rom_list_end(memory, line);
+      }
+      while (memory[line] < 0x40 && rom_list_risky(memory, line));
+      simz80_restore(m, loaded);
+      result = list_program(m, &alone, output, stats);
+    }
+    else
+    {
+      rom_list_line(&list, line);
+      line = list.address;
+    }
+  }
+  free(loaded);
+  free(memory);
+  return result;
+}
+
+// retired machines, linked by their user field, to be reused
+static machine_struct* machine_pool = NULL;
+static pthread_mutex_t machine_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// a machine with ram_size KB of RAM right after it in the same block,
+// taken from the pool when there is one of that size
+static machine_struct* new_machine(int ram_size)
+{
+  unsigned int size = ram_size * 1024;
+  pthread_mutex_lock(&machine_pool_mutex);
+  machine_struct** link = &machine_pool;
+  while (*link != NULL && (*link)->ramsize != size)
+  {
+    link = (machine_struct**)&(*link)->user;
+  }
+  machine_struct* m = *link;
+  if (m != NULL)
+  {
+    *link = (machine_struct*)m->user;
+  }
+  pthread_mutex_unlock(&machine_pool_mutex);
+  if (m == NULL)
+  {
+    m = (machine_struct*)malloc(sizeof(machine_struct) + size);
+    if (m == NULL)
+    {
+      return NULL;
+    }
+    m->ram = (BYTE*)(m + 1);
+  }
+  // RAM only, until the simulation is set up
+  mapmemory(m, NULL, 0, 0x4000, size);
+  m->icount = 0;
+  m->tstates = 0;
+  m->profile = NULL;
+  m->blocks = NULL;
+  m->dirtybase = NULL;
+  return m;
+}
+
+static void free_machine(machine_struct* m)
+{
+  pthread_mutex_lock(&machine_pool_mutex);
+  m->user = machine_pool;
+  machine_pool = m;
+  pthread_mutex_unlock(&machine_pool_mutex);
+}
+
+// takes the state at the end of a LOAD once, to be restored for each program
+static snapshot_struct* new_snapshot(int ram_size)
+{
+  snapshot_struct* loaded = (snapshot_struct*)malloc(sizeof(snapshot_struct));
+  machine_struct* m = new_machine(ram_size);
+  if (loaded == NULL || m == NULL)
+  {
+    free(loaded);
+    if (m != NULL)
+    {
+      free_machine(m);
+    }
+    return NULL;
+  }
+  setup_simulation(m, ram_size);
+  simz80_snapshot(m, loaded);
+  free_machine(m);
+  return loaded;
+}
+
+#ifdef PROFILE
+// adds the counts of p to total
+static void add_profile(profile_struct* total, const profile_struct* p)
+{
+  int i, j;
+  for (i = 0; i < OPGROUPS; i++)
+  {
+    for (j = 0; j < 256; j++)
+    {
+      total->count[i][j] += p->count[i][j];
+    }
+  }
+  for (i = 0; i < Z80MEMSIZE * 1024; i++)
+  {
+    total->pccount[i] += p->pccount[i];
+    total->pctstates[i] += p->pctstates[i];
+    total->calls[i] += p->calls[i];
+  }
+}
+
+// what ran in a ROM routine, or in RAM
+typedef struct
+{
+  const char* name;
+  unsigned long count;
+  unsigned long long tstates;
+  unsigned long calls;
+} routine_t;
+
+static int compare_routines(const void* a, const void* b)
+{
+  const routine_t* x = (const routine_t*)a;
+  const routine_t* y = (const routine_t*)b;
+  return x->tstates < y->tstates ? 1 : x->tstates > y->tstates ? -1 : 0;
+}
+
+// the routine an address of the ROM belongs to, by its index in rom_symbols
+static int rom_routine(int address)
+{
+  int low = 0, high = sizeof(rom_symbols) / sizeof(rom_symbols[0]) - 1;
+  while (low < high)
+  {
+    int middle = (low + high + 1) / 2;
+    if (rom_symbols[middle].address <= address)
+    {
+      low = middle;
+    }
+    else
+    {
+      high = middle - 1;
+    }
+  }
+  return low;
+}
+
+// writes the flat profile of p by ROM routine, the code in RAM counted as one
+static int write_profile(const char* name, const profile_struct* p)
+{
+  FILE* output = fopen(name, "w");
+  if (output == NULL)
+  {
+    fprintf(stderr, "Error opening profile file: %s\n", strerror(errno));
+    return -1;
+  }
+  int count = sizeof(rom_symbols) / sizeof(rom_symbols[0]);
+  routine_t routines[sizeof(rom_symbols) / sizeof(rom_symbols[0]) + 1];
+  int i;
+  for (i = 0; i <= count; i++)
+  {
+    routines[i].name = i < count ? rom_symbols[i].name : "(RAM)";
+    routines[i].count = 0;
+    routines[i].tstates = 0;
+    routines[i].calls = 0;
+  }
+  unsigned long total = 0;
+  unsigned long long total_tstates = 0;
+  for (i = 0; i < Z80MEMSIZE * 1024; i++)
+  {
+    // the ROM is repeated up to the RAM
+    routine_t* routine = routines + (i < 0x4000 ? rom_routine(i & 0x1fff) : count);
+    routine->count += p->pccount[i];
+    routine->tstates += p->pctstates[i];
+    routine->calls += p->calls[i];
+    total += p->pccount[i];
+    total_tstates += p->pctstates[i];
+  }
+  qsort(routines, count + 1, sizeof(routine_t), compare_routines);
+  fprintf(output, "%14s %6s %14s %6s %10s  %s\n", "T-states", "%", "instructions", "%", "calls", "routine");
+  for (i = 0; i <= count && routines[i].count != 0; i++)
+  {
+    fprintf(output, "%14llu %6.2f %14lu %6.2f %10lu  %s\n",
+      routines[i].tstates, total_tstates ? 100.0 * routines[i].tstates / total_tstates : 0.0,
+      routines[i].count, total ? 100.0 * routines[i].count / total : 0.0,
+      routines[i].calls, routines[i].name);
+  }
+  fclose(output);
+  return 0;
+}
+#endif
+
+// lists a part of a single listing on a machine of its own
+static void* range_worker(void* data)
+{
+  parts_t* parts = (parts_t*)data;
+  machine_struct* m = new_machine(parts->ranges[0].options.ram_size);
+  for (;;)
+  {
+    // take the next part
+    pthread_mutex_lock(&parts->mutex);
+    int index = parts->next++;
+    pthread_mutex_unlock(&parts->mutex);
+    if (index >= parts->count)
+    {
+      break;
+    }
+    range_t* range = parts->ranges + index;
+    if (m == NULL)
+    {
+      fprintf(stderr, "Out of memory\n");
+      range->result = -1;
+      continue;
+    }
+    simz80_restore(m, range->loaded);
+    sink_t sink;
+    sink_init(&sink, NULL);
+    unsigned long icount = m->icount;
+    range->result = list_program(m, &range->options, &sink, &range->stats);
+    range->stats.instructions = m->icount - icount;
+    if (sink.error)
+    {
+      fprintf(stderr, "Out of memory\n");
+      range->result = -1;
+    }
+    range->text = sink_take(&sink, &range->size);
+  }
+  if (m != NULL)
+  {
+    free_machine(m);
+  }
+  return NULL;
+}
+
+// lists the loaded program split into parts of about the same size, each
+// started at its first line as -s does and stopped after its last line, on
+// machines of their own in parallel, as many at a time as there are worker
+// threads, and writes the parts in order, so the
+// output is the same as list_program's. A listing that reaches the memory
+// LIST writes to and the smaller machines are listed in one part, as in
+// list_hybrid, and so are listings with -i or -k, whose limits are for the
+// whole listing and stop it where only one machine can. Returns a LIST_
+// value, or -1 on errors.
+static int list_ranges(machine_struct* m, const options_t* options, sink_t* output, stats_t* stats)
+{
+  if (m->ramsize != 48 * 1024 || options->budget != 0 || options->timeout > 0)
+  {
+    return list_program(m, options, output, stats);
+  }
+  unsigned char* memory = (unsigned char*)malloc(65536);
+  range_t* ranges = (range_t*)calloc(options->ranges, sizeof(range_t));
+  pthread_t* workers = (pthread_t*)malloc(options->threads * sizeof(pthread_t));
+  snapshot_struct* loaded = (snapshot_struct*)malloc(sizeof(snapshot_struct));
+  if (memory == NULL || ranges == NULL || workers == NULL || loaded == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    free(memory);
+    free(ranges);
+    free(workers);
+    free(loaded);
+    return -1;
+  }
+  memcpy(memory + 0x4000, m->ram, m->ramsize);
+  // a program without an ending is left to list_program to report
+  unsigned limit = options->full && rom_list_full(memory) != 0 ? 0 : list_limit(memory);
+
+  // the size of the listing, in bytes of the program
+  unsigned first = rom_list_addr(memory, options->start);
+  unsigned line = first;
+  while (line < limit && memory[line] < 0x40 && rom_list_end(memory, line) <= limit)
+  {
+    line = rom_list_end(memory, line);
+  }
+  int count = 0; // parts
+  if (line < limit && memory[line] >= 0x40)
+  {
+    // a part starts at the first line -s can get to past its share
+    unsigned size = line - first;
+    int lines = 0;
+    for (line = first; memory[line] < 0x40; line = rom_list_end(memory, line))
+    {
+      if (count == 0 || (count < options->ranges && line - first >= (unsigned long)size * count / options->ranges && list_reachable(memory, line)))
+      {
+        if (count > 0)
+        {
+          ranges[count - 1].options.lines = lines;
+        }
+        ranges[count].loaded = loaded;
+        ranges[count].options = *options;
+        ranges[count].options.start = count == 0 ? options->start : memory[line] << 8 | memory[line + 1];
+        count++;
+        lines = 0;
+      }
+      lines++;
+    }
+  }
+  free(memory);
+  if (count <= 1)
+  {
+    free(ranges);
+    free(workers);
+    free(loaded);
+    return list_program(m, options, output, stats);
+  }
+
+  // list the parts, the main thread being one of the workers, and the only
+  // one if no other can be started
+  simz80_snapshot(m, loaded);
+  parts_t parts;
+  parts.ranges = ranges;
+  parts.count = count;
+  parts.next = 0;
+  pthread_mutex_init(&parts.mutex, NULL);
+  int started;
+  for (started = 0; started < options->threads - 1 && started < count - 1; started++)
+  {
+    if (pthread_create(workers + started, NULL, range_worker, &parts) != 0)
+    {
+      break;
+    }
+  }
+  range_worker(&parts);
+  int i;
+  for (i = 0; i < started; i++)
+  {
+    pthread_join(workers[i], NULL);
+  }
+  pthread_mutex_destroy(&parts.mutex);
+  // a part that doesn't end well ends the listing there, as it would
+  int result = LIST_DONE;
+  for (i = 0; i < count; i++)
+  {
+    if (result == LIST_DONE)
+    {
+      result = ranges[i].result;
+      sink_write(output, ranges[i].text, ranges[i].size);
+      add_stats(stats, &ranges[i].stats);
+    }
+    free(ranges[i].text);
+  }
+  free(ranges);
+  free(workers);
+  free(loaded);
+  return result;
+}
+
+// dir/input.txt, without the directory and the extension of the input file
+static void output_path(char* output_name, size_t size, const char* output_dir, const char* input_name)
+{
+  const char* base = strrchr(input_name, '/');
+  base = base == NULL ? input_name : base + 1;
+  const char* dot = strrchr(base, '.');
+  int len = dot == NULL ? (int)strlen(base) : (int)(dot - base);
+  snprintf(output_name, size, "%s/%.*s.txt", output_dir, len, base);
+}
+
+static int compare_names(const void* a, const void* b)
+{
+  return strcmp(*(const char**)a, *(const char**)b);
+}
+
+// returns -1 if two inputs would be listed to the same file of output_dir
+static int check_outputs(const char* output_dir, const char** inputs, int count)
+{
+  char** names = (char**)malloc(count * sizeof(char*));
+  if (names == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return -1;
+  }
+  int result = 0;
+  int i;
+  for (i = 0; i < count; i++)
+  {
+    char output_name[FILENAME_MAX];
+    output_path(output_name, sizeof(output_name), output_dir, inputs[i]);
+    names[i] = strdup(output_name);
+    if (names[i] == NULL)
+    {
+      fprintf(stderr, "Out of memory\n");
+      count = i;
+      result = -1;
+      break;
+    }
+  }
+  // the same names are next to each other once sorted
+  qsort(names, count, sizeof(char*), compare_names);
+  for (i = 1; i < count && result == 0; i++)
+  {
+    if (!strcmp(names[i - 1], names[i]))
+    {
+      fprintf(stderr, "Inputs with the same name would be listed to %s\n", names[i]);
+      result = -1;
+    }
+  }
+  for (i = 0; i < count; i++)
+  {
+    free(names[i]);
+  }
+  free(names);
+  return result;
+}
+
+static int list_job(machine_struct* m, const batch_t* batch, job_t* job)
+{
+  double start = now();
+  long size = load_program(m, batch->loaded, job->input_name);
+  if (size < 0)
+  {
+    return -1;
+  }
+  job->stats.files = 1;
+  job->stats.bytes = size;
+  job->stats.load = now() - start;
+  FILE* output = NULL;
+  if (batch->output_dir != NULL)
+  {
+    char output_name[FILENAME_MAX];
+    output_path(output_name, sizeof(output_name), batch->output_dir, job->input_name);
+    output = fopen(output_name, "wb");
+    if (output == NULL)
+    {
+      fprintf(stderr, "Error opening output file: %s\n", strerror(errno));
+      return -1;
+    }
+  }
+  // without a file the listing is kept for the main thread to write in order
+  sink_t sink;
+  sink_init(&sink, output);
+  start = now();
+  unsigned long icount = m->icount;
+  int result = batch->options->hybrid ? list_hybrid(m, batch->options, &sink, &job->stats) : list_program(m, batch->options, &sink, &job->stats);
+  job->stats.instructions = m->icount - icount;
+  double stop = now();
+  job->stats.emulate = stop - start;
+  if (output == NULL && !sink.error)
+  {
+    job->text = sink_take(&sink, &job->size);
+  }
+  if (sink_close(&sink) != 0)
+  {
+    fprintf(stderr, "Error writing output: %s\n", strerror(errno));
+    result = -1;
+  }
+  if (output != NULL && fclose(output) != 0 && result >= 0)
+  {
+    fprintf(stderr, "Error writing output: %s\n", strerror(errno));
+    result = -1;
+  }
+  job->stats.write = now() - stop;
+  return result;
+}
+
+static void* worker(void* data)
+{
+  batch_t* batch = (batch_t*)data;
+  machine_struct* m = new_machine(batch->options->ram_size);
+#ifdef PROFILE
+  if (m != NULL && batch->profile != NULL)
+  {
+    m->profile = (profile_struct*)calloc(1, sizeof(profile_struct));
+  }
+#endif
+  for (;;)
+  {
+    // take the next input
+    pthread_mutex_lock(&batch->mutex);
+    int index = batch->next++;
+    pthread_mutex_unlock(&batch->mutex);
+    if (index >= batch->count)
+    {
+      break;
+    }
+    job_t* job = batch->jobs + index;
+    if (m == NULL)
+    {
+      fprintf(stderr, "Out of memory\n");
+      job->result = -1;
+    }
+    else
+    {
+      job->result = list_job(m, batch, job);
+    }
+    // tell the main thread it's done
+    pthread_mutex_lock(&batch->mutex);
+    job->done = 1;
+    pthread_cond_broadcast(&batch->done);
+    pthread_mutex_unlock(&batch->mutex);
+  }
+  if (m != NULL)
+  {
+#ifdef PROFILE
+    if (m->profile != NULL)
+    {
+      pthread_mutex_lock(&batch->mutex);
+      add_profile(batch->profile, m->profile);
+      pthread_mutex_unlock(&batch->mutex);
+      free(m->profile);
+      m->profile = NULL;
+    }
+#endif
+    free_machine(m);
+  }
+  return NULL;
+}
+
+static int add_input(const char*** inputs, int* count, const char* name)
+{
+  const char** grown = (const char**)realloc(*inputs, (*count + 1) * sizeof(const char*));
+  if (grown == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return -1;
+  }
+  grown[(*count)++] = name;
+  *inputs = grown;
+  return 0;
+}
+
+static int add_directory(const char*** inputs, int* count, const char* dir_name)
+{
+  DIR* dir = opendir(dir_name);
+  if (dir == NULL)
+  {
+    return add_input(inputs, count, dir_name);
+  }
+  // P files in the directory are listed in name order
+  int first = *count;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL)
+  {
+    const char* dot = strrchr(entry->d_name, '.');
+    if (dot == NULL || (strcmp(dot, ".p") && strcmp(dot, ".P")))
+    {
+      continue;
+    }
+    char* name = (char*)malloc(strlen(dir_name) + strlen(entry->d_name) + 2);
+    if (name == NULL || add_input(inputs, count, name) != 0)
+    {
+      closedir(dir);
+      return -1;
+    }
+    sprintf(name, "%s/%s", dir_name, entry->d_name);
+  }
+  closedir(dir);
+  qsort(*inputs + first, *count - first, sizeof(const char*), compare_names);
+  return 0;
+}
+
+static void poke_word(machine_struct* m, int address, int value)
+{
+  RAMBYTE(m, address    ) = value & 0xff;
+  RAMBYTE(m, address + 1) = value >> 8;
+}
+
+// puts a program in memory as if it had been loaded, for the benchmark
+static void bench_program(machine_struct* m)
+{
+  int address = 0x407d; // address of first line
+  int line, ch;
+  // 60 lines with a REM followed by all the characters and tokens
+  for (line = 1; line <= 60; line++)
+  {
+    RAMBYTE(m, address++) = (line * 10) >> 8;
+    RAMBYTE(m, address++) = (line * 10) & 0xff;
+    poke_word(m, address, 1 + 192 + 1);
+    address += 2;
+    RAMBYTE(m, address++) = 0xea; // REM
+    for (ch = 0; ch < 256; ch++)
+    {
+      if (ch < 0x40 || ch >= 0x80)
+      {
+        RAMBYTE(m, address++) = ch;
+      }
+    }
+    RAMBYTE(m, address++) = 0x76;
+  }
+  // an empty display file and no variables
+  int d_file = address;
+  memset(&RAMBYTE(m, d_file), 0x76, 25);
+  RAMBYTE(m, d_file + 25) = 0x80;
+  int e_line = d_file + 26;
+  // the system variables saved in a P file
+  poke_word(m, E_PPC, 300);
+  poke_word(m, D_FILE, d_file);
+  poke_word(m, DF_CC, d_file + 1);
+  poke_word(m, VARS, d_file + 25);
+  poke_word(m, E_LINE, e_line);
+  poke_word(m, CH_ADD, e_line + 4);
+  poke_word(m, STKBOT, e_line + 5);
+  poke_word(m, STKEND, e_line + 5);
+  poke_word(m, MEM, 0x405d);
+  RAMBYTE(m, DF_SZ) = 2;
+  poke_word(m, LAST_K, 0xffff);
+  RAMBYTE(m, MARGIN) = 55;
+  poke_word(m, NXTLIN, d_file);
+  RAMBYTE(m, S_POSN    ) = 33;
+  RAMBYTE(m, S_POSN + 1) = 24;
+  markdirty(m, ERR_NR, e_line - 1);
+}
+
+#ifdef PROFILE
+// an opcode of the profile
+typedef struct
+{
+  unsigned long count;
+  int group;
+  int op;
+} opcount_t;
+
+static int compare_counts(const void* a, const void* b)
+{
+  const opcount_t* x = (const opcount_t*)a;
+  const opcount_t* y = (const opcount_t*)b;
+  return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+// reports the T-states and the opcodes run the most
+static void print_profile(const machine_struct* m)
+{
+  static const char* prefix[OPGROUPS] = { "", "CB ", "ED ", "DD ", "FD ", "DDCB ", "FDCB " };
+  static opcount_t ops[OPGROUPS * 256];
+  int i;
+  for (i = 0; i < OPGROUPS * 256; i++)
+  {
+    ops[i].count = m->profile->count[i / 256][i % 256];
+    ops[i].group = i / 256;
+    ops[i].op = i % 256;
+  }
+  qsort(ops, OPGROUPS * 256, sizeof(opcount_t), compare_counts);
+  fprintf(stderr, "%llu T-states, %.2f per instruction\n", m->tstates, (double)m->tstates / m->icount);
+  for (i = 0; i < 32 && ops[i].count != 0; i++)
+  {
+    fprintf(stderr, "%-5s%02X %12lu %6.2f%%\n", prefix[ops[i].group], ops[i].op, ops[i].count, 100.0 * ops[i].count / m->icount);
+  }
+}
+#endif
+
+// lists the benchmark program many times and reports the emulation speed
+static int benchmark(const options_t* options, int times)
+{
+  machine_struct* m = new_machine(options->ram_size);
+  snapshot_struct* loaded = new_snapshot(options->ram_size);
+  FILE* output = fopen("/dev/null", "wb");
+  sink_t sink;
+  sink_init(&sink, output);
+  stats_t stats;
+  memset(&stats, 0, sizeof(stats));
+  if (m == NULL || loaded == NULL || output == NULL)
+  {
+    fprintf(stderr, "Error setting up the benchmark\n");
+    return -1;
+  }
+#ifdef PROFILE
+  m->profile = (profile_struct*)calloc(1, sizeof(profile_struct));
+  if (m->profile == NULL)
+  {
+    fprintf(stderr, "Error setting up the benchmark\n");
+    return -1;
+  }
+#endif
+  clock_t start = clock();
+  int i;
+  for (i = 0; i < times; i++)
+  {
+    simz80_restore(m, loaded);
+    bench_program(m);
+    list_program(m, options, &sink, &stats);
+  }
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  fprintf(stderr, "%lu instructions in %.3f s, %.2f MIPS\n", m->icount, seconds, m->icount / seconds / 1e6);
+#ifdef PROFILE
+  print_profile(m);
+  if (options->profile_name != NULL)
+  {
+    write_profile(options->profile_name, m->profile);
+  }
+  free(m->profile);
+  m->profile = NULL;
+#endif
+  sink_close(&sink);
+  fclose(output);
+  free(loaded);
+  free_machine(m);
+  return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+  double start = now();
+  
+  // check execution without arguments
+  if (argc < 2)
+  {
+    usage(stderr);
+    return -1;
+  }
+  
+  // configuration variables
+  options_t options;
+  options.show_cursor = 0;
+  options.table = tokens_ascii;
+  options.width = 32;
+  options.start = 0;
+  options.full = 0;
+  options.trap = 0;
+  options.hybrid = 0;
+  options.lines = 0;
+  options.ranges = 1;
+  options.ram_size = 48;
+  options.budget = 0;
+  options.timeout = 0;
+  options.profile_name = NULL;
+  const char* output_name = "<stdout>";
+  FILE* output = stdout;
+  const char** inputs = NULL;
+  int count = 0;
+  const char* output_dir = NULL;
+  int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int from_stdin = 0;
+  int bench = 0;
+  int show_stats = 0;
+  stats_t stats;
+  memset(&stats, 0, sizeof(stats));
+  
+  // process command line arguments
+  int i;
+  for (i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "-c"))
+    {
+      options.show_cursor = !options.show_cursor;
+    }
+    else if (!strcmp(argv[i], "-z"))
+    {
+      options.table = options.table == tokens_ascii ? tokens_zx81 : tokens_ascii;
+    }
+    else if (!strcmp(argv[i], "-w"))
+    {
+      if ((i + 1) >= argc)
+      {
+        fprintf(stderr, "Missing argument to -w\n");
+        return -1;
+      }
+      options.width = atoi(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "-a"))
+    {
+      options.show_cursor = 1;
+      options.table = tokens_zx81;
+      options.width = 32;
+      options.full = 0;
+    }
+    else if (!strcmp(argv[i], "-s"))
+    {
+      if ((i + 1) >= argc)
+      {
+        fprintf(stderr, "Missing argument to -s\n");
+        return -1;
+      }
+      options.start = atoi(argv[++i]);
+      if (options.start < 0 || options.start > 9999)
+      {
+        fprintf(stderr, "Invalid argument to -s, line must be between 0 and 9999\n");
+        return -1;
+      }
+    }
+    else if (!strcmp(argv[i], "-f"))
+    {
+      options.full = !options.full;
+    }
+    else if (!strcmp(argv[i], "-t"))
+    {
+      options.trap = !options.trap;
+    }
+    else if (!strcmp(argv[i], "-n"))
+    {
+      options.hybrid = !options.hybrid;
+    }
+    else if (!strcmp(argv[i], "-r"))
+    {
+      if ((i + 1) >= argc)
+      {
+        fprintf(stderr, "Missing argument to -r\n");
+        return -1;
+      }
+      options.ranges = atoi(argv[++i]);
+      if (options.ranges < 1)
+      {
+        fprintf(stderr, "Invalid argument to -r, must be at least 1\n");
+        return -1;
+      }
+    }
+    else if (!strcmp(argv[i], "-m"))
+    {
+      if ((i + 1) >= argc)
+      {
+        fprintf(stderr, "Missing argument to -m\n");
+        return -1;
+      }
+      options.ram_size = atoi(argv[++i]);
+      if (options.ram_size != 1 && options.ram_size != 2 && options.ram_size != 16 && options.ram_size != 32 && options.ram_size != 48)
+      {
+        fprintf(stderr, "Invalid argument to -m, must be 1, 2, 16, 32 or 48\n");
+        return -1;
+      }
+    }
+    else if (!strcmp(argv[i], "-i"))
+    {
+      if ((i + 1) >= argc)
+      {
+        fprintf(stderr, "Missing argument to -i\n");
+        return -1;
+      }
+      options.budget = strtoul(argv[++i], NULL, 10);
+      if (options.budget == 0)
+      {
+        fprintf(stderr, "Invalid argument to -i, must be at least 1\n");
+        return -1;
+      }
+    }
+    else if (!strcmp(argv[i], "-k"))
+    {
+      if ((i + 1) >= argc)
+      {
+        fprintf(stderr, "Missing argument to -k\n");
+        return -1;
+      }
+      options.timeout = atof(argv[++i]);
+      if (options.timeout <= 0)
+      {
+        fprintf(stderr, "Invalid argument to -k, must be more than 0\n");
+        return -1;
+      }
+    }
+    else if (!strcmp(argv[i], "-p"))
+    {
+      if ((i + 1) >= argc)
+      {
+        fprintf(stderr, "Missing argument to -p\n");
+        return -1;
+      }
+#ifdef PROFILE
+      options.profile_name = argv[++i];
+#else
+      fprintf(stderr, "Profiling needs wmaplist-profile, built with make wmaplist-profile\n");
+      return -1;
+#endif
+    }
+    else if (!strcmp(argv[i], "-o"))
+    {
+      if ((i + 1) >= argc)
+      {
+        fprintf(stderr, "Missing argument to -o\n");
+        return -1;
+      }
+      output_name = argv[++i];
+    }
+    else if (!strcmp(argv[i], "-d"))
+    {
+      if ((i + 1) >= argc)
+      {
+        fprintf(stderr, "Missing argument to -d\n");
+        return -1;
+      }
+      output_dir = argv[++i];
+    }
+    else if (!strcmp(argv[i], "-j"))
+    {
+      if ((i + 1) >= argc)
+      {
+        fprintf(stderr, "Missing argument to -j\n");
+        return -1;
+      }
+      threads = atoi(argv[++i]);
+      if (threads < 1)
+      {
+        fprintf(stderr, "Invalid argument to -j, must be at least 1\n");
+        return -1;
+      }
+    }
+    else if (!strcmp(argv[i], "-l"))
+    {
+      from_stdin = 1;
+    }
+    else if (!strcmp(argv[i], "-b"))
+    {
+      if ((i + 1) >= argc)
+      {
+        fprintf(stderr, "Missing argument to -b\n");
+        return -1;
+      }
+      bench = atoi(argv[++i]);
+      if (bench < 1)
+      {
+        fprintf(stderr, "Invalid argument to -b, must be at least 1\n");
+        return -1;
+      }
+    }
+    else if (!strcmp(argv[i], "--stats"))
+    {
+      show_stats = 1;
+    }
+    else if (argv[i][0] != '-')
+    {
+      if (add_directory(&inputs, &count, argv[i]) != 0)
+      {
+        return -1;
+      }
+    }
+    else if (!strcmp(argv[i], "-h"))
+    {
+      usage(stdout);
+      return 0;
+    }
+    else
+    {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return -1;
+    }
+  }
+  
+  // -r lists in as many threads as the batch
+  options.threads = threads;
+  
+  if (bench)
+  {
+    return benchmark(&options, bench);
+  }
+  
+  // read more input names from stdin, one per line
+  if (from_stdin)
+  {
+    char line[FILENAME_MAX];
+    while (fgets(line, sizeof(line), stdin) != NULL)
+    {
+      line[strcspn(line, "\r\n")] = 0;
+      if (*line == 0)
+      {
+        continue;
+      }
+      char* name = strdup(line);
+      if (name == NULL || add_directory(&inputs, &count, name) != 0)
+      {
+        return -1;
+      }
+    }
+  }
+  
+  // check for required inputs, which the thread pool needs too
+  if (count == 0)
+  {
+    fprintf(stderr, "Missing input file\n");
+    return -1;
+  }
+  
+  // the machine as it is after a LOAD, for all the inputs
+  double setup = now();
+  snapshot_struct* loaded = new_snapshot(options.ram_size);
+  if (loaded == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return -1;
+  }
+  stats.setup = now() - setup;
+  
+  // a single input is listed right away
+  if (count == 1 && output_dir == NULL)
+  {
+    machine_struct* m = new_machine(options.ram_size);
+    if (m == NULL)
+    {
+      fprintf(stderr, "Out of memory\n");
+      return -1;
+    }
+    double load = now();
+    long size = load_program(m, loaded, inputs[0]);
+    if (size < 0)
+    {
+      return -1;
+    }
+    stats.files = 1;
+    stats.bytes = size;
+    stats.load = now() - load;
+    
+    // setup output file
+    if (strcmp(output_name, "<stdout>"))
+    {
+      output = fopen(output_name, "wb");
+      if (output == NULL)
+      {
+        fprintf(stderr, "Error opening output file: %s\n", strerror(errno));
+        return -1;
+      }
+    }
+    // with --stats the listing is kept in memory and written at the end,
+    // so the emulation and the writing are timed apart
+    sink_t sink;
+    sink_init(&sink, show_stats ? NULL : output);
+    
+#ifdef PROFILE
+    if (options.profile_name != NULL)
+    {
+      m->profile = (profile_struct*)calloc(1, sizeof(profile_struct));
+      if (m->profile == NULL)
+      {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+      }
+    }
+#endif
+    double emulate = now();
+    unsigned long icount = m->icount;
+    int result;
+    if (options.hybrid)
+    {
+      result = list_hybrid(m, &options, &sink, &stats);
+    }
+    else if (options.ranges > 1 && options.profile_name == NULL)
+    {
+      result = list_ranges(m, &options, &sink, &stats);
+    }
+    else
+    {
+      result = list_program(m, &options, &sink, &stats);
+    }
+    // the instructions run by other machines are already counted
+    stats.instructions += m->icount - icount;
+    stats.emulate = now() - emulate;
+    if (result > LIST_DONE)
+    {
+      fprintf(stderr, "Listing stopped: %s\n", list_result(result));
+    }
+#ifdef PROFILE
+    if (m->profile != NULL)
+    {
+      if (write_profile(options.profile_name, m->profile) != 0)
+      {
+        result = -1;
+      }
+      free(m->profile);
+      m->profile = NULL;
+    }
+#endif
+    
+    // all done, close output file and exit
+    double write = now();
+    sink.file = output;
+    if (sink_close(&sink) != 0)
+    {
+      fprintf(stderr, "Error writing output: %s\n", strerror(errno));
+      result = -1;
+    }
+    if ((output != stdout ? fclose(output) : fflush(output)) != 0 && result >= 0)
+    {
+      fprintf(stderr, "Error writing output: %s\n", strerror(errno));
+      result = -1;
+    }
+    stats.write = now() - write;
+    free_machine(m);
+    free(loaded);
+    if (show_stats)
+    {
+      print_stats(stderr, "wmaplist", &stats, start, 1);
+    }
+    return result == LIST_DONE ? 0 : result < 0 ? -1 : 2;
+  }
+  
+  // each input needs a file of its own
+  if (output_dir != NULL && check_outputs(output_dir, inputs, count) != 0)
+  {
+    return -1;
+  }
+  
+  // setup the combined output file
+  if (output_dir == NULL && strcmp(output_name, "<stdout>"))
+  {
+    output = fopen(output_name, "wb");
+    if (output == NULL)
+    {
+      fprintf(stderr, "Error opening output file: %s\n", strerror(errno));
+      return -1;
+    }
+  }
+  
+  // setup the batch
+  batch_t batch;
+  batch.options = &options;
+  batch.loaded = loaded;
+  batch.output_dir = output_dir;
+  batch.jobs = (job_t*)calloc(count, sizeof(job_t));
+  batch.count = count;
+  batch.next = 0;
+  batch.profile = NULL;
+#ifdef PROFILE
+  if (options.profile_name != NULL)
+  {
+    batch.profile = (profile_struct*)calloc(1, sizeof(profile_struct));
+  }
+  if (options.profile_name != NULL && batch.profile == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return -1;
+  }
+#endif
+  if (batch.jobs == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return -1;
+  }
+  for (i = 0; i < count; i++)
+  {
+    batch.jobs[i].input_name = inputs[i];
+  }
+  pthread_mutex_init(&batch.mutex, NULL);
+  pthread_cond_init(&batch.done, NULL);
+  
+  // start the workers
+  if (threads > count)
+  {
+    threads = count;
+  }
+  pthread_t* workers = (pthread_t*)malloc(threads * sizeof(pthread_t));
+  if (workers == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return -1;
+  }
+  int started;
+  int error = 0;
+  for (started = 0; started < threads; started++)
+  {
+    error = pthread_create(workers + started, NULL, worker, &batch);
+    if (error != 0)
+    {
+      break;
+    }
+  }
+  if (started == 0)
+  {
+    fprintf(stderr, "Error creating worker threads: %s\n", strerror(error));
+    return -1;
+  }
+  
+  // write the listings in the order of the inputs as they are done
+  int result = 0;
+  int write_error = 0;
+  for (i = 0; i < count; i++)
+  {
+    job_t* job = batch.jobs + i;
+    pthread_mutex_lock(&batch.mutex);
+    while (!job->done)
+    {
+      pthread_cond_wait(&batch.done, &batch.mutex);
+    }
+    pthread_mutex_unlock(&batch.mutex);
+    if (job->result < 0)
+    {
+      fprintf(stderr, "Error listing %s\n", job->input_name);
+      result = -1;
+    }
+    else if (job->result != LIST_DONE)
+    {
+      // the listing is written as far as it got
+      fprintf(stderr, "Listing of %s stopped: %s\n", job->input_name, list_result(job->result));
+      if (result == 0)
+      {
+        result = 2;
+      }
+    }
+    add_stats(&stats, &job->stats);
+    if (job->text != NULL)
+    {
+      double write = now();
+      if (fwrite(job->text, 1, job->size, output) != job->size && !write_error)
+      {
+        fprintf(stderr, "Error writing output: %s\n", strerror(errno));
+        write_error = 1;
+        result = -1;
+      }
+      stats.write += now() - write;
+      free(job->text);
+      job->text = NULL;
+    }
+  }
+  
+  // all done, close output file and exit
+  for (i = 0; i < started; i++)
+  {
+    pthread_join(workers[i], NULL);
+  }
+  free(workers);
+#ifdef PROFILE
+  if (batch.profile != NULL)
+  {
+    if (write_profile(options.profile_name, batch.profile) != 0)
+    {
+      result = -1;
+    }
+    free(batch.profile);
+  }
+#endif
+  free(batch.jobs);
+  free(loaded);
+  double write = now();
+  if ((output != stdout ? fclose(output) : fflush(output)) != 0 && !write_error)
+  {
+    fprintf(stderr, "Error writing output: %s\n", strerror(errno));
+    result = -1;
+  }
+  stats.write += now() - write;
+  if (show_stats)
+  {
+    print_stats(stderr, "wmaplist", &stats, start, 1);
+  }
+  return result;
 }
@@ -24,6 +24,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <errno.h>
 #include "zx81rom.h"
 #include "xltables.h"
+#include "stats.h"
 
 typedef struct
 {
@@ -72,14 +73,17 @@ static void write32(FILE* out, uint32_t x)
 static void usage(FILE* out)
 {
   fprintf(out, "ZX81TEXT - Generates BMP images with text using the ZX-81 font.\n\n");
-  fprintf(out, "Usage: zx81text [-h] [-o output]\n\n");
-  fprintf(out, "-o    Output bitmap to file \"output\"\n\n");
+  fprintf(out, "Usage: zx81text [-h] [-o output] [--stats]\n\n");
+  fprintf(out, "-o    Output bitmap to file \"output\"\n");
+  fprintf(out, "--stats Print the times of each phase and the amounts read and output to stderr\n\n");
   fprintf(out, "The purpose of this software is to generate bitmap images from listings\n");
   fprintf(out, "produced by AGEPLIST and WMAPLIST.\n");
 }
 
 int main(int argc, const char* argv[])
 {
+  double start = now();
+  
   // check execution without arguments
   if (argc < 2)
   {
@@ -87,26 +91,48 @@ int main(int argc, const char* argv[])
     return -1;
   }
   
-  // check for -h
-  if (!strcmp(argv[1], "-h"))
+  // process command line arguments
+  const char* output_name = NULL;
+  int show_stats = 0;
+  stats_t stats;
+  memset(&stats, 0, sizeof(stats));
+  int i;
+  for (i = 1; i < argc; i++)
   {
-    usage(stdout);
-    return 0;
+    if (!strcmp(argv[i], "-h"))
+    {
+      usage(stdout);
+      return 0;
+    }
+    else if (!strcmp(argv[i], "-o"))
+    {
+      if ((i + 1) >= argc)
+      {
+        fprintf(stderr, "Missing argument to -o\n");
+        return -1;
+      }
+      output_name = argv[++i];
+    }
+    else if (!strcmp(argv[i], "--stats"))
+    {
+      show_stats = 1;
+    }
+    else
+    {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return -1;
+    }
   }
   
   // check for required argument
-  if (strcmp(argv[1], "-o"))
+  if (output_name == NULL)
   {
     fprintf(stderr, "Missing -o option\n");
     return -1;
   }
-  if (argc < 3)
-  {
-    fprintf(stderr, "Missing argument to -o\n");
-    return -1;
-  }
   
   // read the file into memory, maximum line width is 8 KiB
+  double load = now();
   line_t* last_line = NULL;
   char line[8192];
   int total_lines = 0;
@@ -115,6 +141,7 @@ int main(int argc, const char* argv[])
   {
     // force string termination
     line[sizeof(line) - 1] = 0;
+    stats.bytes += strlen(line);
     // remove \r and \n from the end of the string
     char* aux = line + strlen(line) - 1;
     while (aux >= line && (*aux == '\r' || *aux == '\n'))
@@ -129,11 +156,15 @@ int main(int argc, const char* argv[])
     next_line->line = strdup(line);
     total_lines++;
     int len = strlen(line);
+    stats.chars += len;
     if (len > max_columns)
     {
       max_columns = len;
     }
   }
+  stats.files = 1;
+  stats.lines = total_lines;
+  stats.load = now() - load;
 
   // check if there is text to output
   if (total_lines == 0 || max_columns == 0)
@@ -146,40 +177,17 @@ int main(int argc, const char* argv[])
   int width = (max_columns * 8 + 31) & ~31;
   int height = total_lines * 8;
   
-  // setup output file
-  FILE* output = fopen(argv[2], "wb");
-  if (output == NULL)
+  // render the pixels in memory, so the rendering and the writing are
+  // timed apart
+  double setup = now();
+  uint8_t* pixels = (uint8_t*)calloc(width / 8, height);
+  if (pixels == NULL)
   {
-    fprintf(stderr, "Error opening output file: %s\n", strerror(errno));
+    fprintf(stderr, "Out of memory\n");
     return -1;
   }
-
-	// write the Win32 BMP file header (14 bytes)
-	write8(output, 'B');                               // magic
-  write8(output, 'M');                               // magic
-	write32(output, 14 + 40 + width / 8 * height + 8); // bfSize (file size)
-  write32(output, 0);                                // bfReserved1 & bfReserved2
-	write32(output, 14 + 40 + 8);                      // bfOffBits
-
-	// write the Win32 BITMAPINFOHEADER struct (40 bytes)
-	write32(output, 40);                 // biSize
-	write32(output, max_columns * 8);    // biWidth
-	write32(output, height);             // biHeight
-	write16(output, 1);                  // biPlanes
-	write16(output, 1);                  // biBitCount
-	write32(output, 0);                  // biCompression
-	write32(output, width / 8 * height); // biSizeImage
-	write32(output, 72 * 10000 / 254);   // biXPelsPerMeter
-	write32(output, 72 * 10000 / 254);   // biYPelsPerMeter
-	write32(output, 2);                  // biClrUsed
-	write32(output, 2);                  // biClrImportant
-  
-  // write the color palette
-  write32(output, 0x00ffffff);
-  write32(output, 0);
-	
-  // write the pixels
   const uint8_t* char_table = rom + 0x1e00;
+  uint8_t* pixel = pixels;
   line_t* current = last_line;
   while (current != NULL)
   {
@@ -205,22 +213,53 @@ int main(int argc, const char* argv[])
           index -= 128;
           invert = 0xff;
         }
-        // output the bits of the character corresponding to line_count
-        write8(output, char_table[index * 8 + line_count] ^ invert);
-      }
-      // complete the horizontal line
-      while (column++ < max_columns)
-      {
-        write8(output, 0);
-      }
-      // pad the horizontal line
-      for (column = width / 8 - max_columns; column != 0; column--)
-      {
-        write8(output, 0);
+        // the bits of the character corresponding to line_count
+        pixel[column] = char_table[index * 8 + line_count] ^ invert;
       }
+      // the rest of the horizontal line and its padding are left blank
+      pixel += width / 8;
     }
     current = current->previous;
   }
+  stats.setup = now() - setup;
+  
+  // setup output file
+  double write = now();
+  FILE* output = fopen(output_name, "wb");
+  if (output == NULL)
+  {
+    fprintf(stderr, "Error opening output file: %s\n", strerror(errno));
+    return -1;
+  }
+
+	// write the Win32 BMP file header (14 bytes)
+	write8(output, 'B');                               // magic
+  write8(output, 'M');                               // magic
+	write32(output, 14 + 40 + width / 8 * height + 8); // bfSize (file size)
+  write32(output, 0);                                // bfReserved1 & bfReserved2
+	write32(output, 14 + 40 + 8);                      // bfOffBits
+
+	// write the Win32 BITMAPINFOHEADER struct (40 bytes)
+	write32(output, 40);                 // biSize
+	write32(output, max_columns * 8);    // biWidth
+	write32(output, height);             // biHeight
+	write16(output, 1);                  // biPlanes
+	write16(output, 1);                  // biBitCount
+	write32(output, 0);                  // biCompression
+	write32(output, width / 8 * height); // biSizeImage
+	write32(output, 72 * 10000 / 254);   // biXPelsPerMeter
+	write32(output, 72 * 10000 / 254);   // biYPelsPerMeter
+	write32(output, 2);                  // biClrUsed
+	write32(output, 2);                  // biClrImportant
+  
+  // write the color palette
+  write32(output, 0x00ffffff);
+  write32(output, 0);
+	
+  // write the pixels
+  int result = 0;
+  fwrite(pixels, width / 8, height, output);
+  free(pixels);
   
   // all done, free the lines, close output file and exit
   current = last_line;
@@ -231,6 +270,16 @@ int main(int argc, const char* argv[])
     current = current->previous;
     free(last_line);
   }
-  fclose(output);
-  return 0;
+  int failed = ferror(output);
+  if (fclose(output) != 0 || failed)
+  {
+    fprintf(stderr, "Error writing output file: %s\n", strerror(errno));
+    result = -1;
+  }
+  stats.write = now() - write;
+  if (show_stats)
+  {
+    print_stats(stderr, "zx81text", &stats, start, 0);
+  }
+  return result;
 }